@@ -53,8 +53,11 @@ namespace networking {
 	}
 
 	void Buffer::Free(Buffer::Vector* buffer) {
-		if(buffer)
+		if(buffer) {
+			if(buffer->capacity() > MAX_POOLED_CAPACITY)
+				std::vector<uint8_t>().swap(buffer->vector);
 			impl::bufferPool.release(buffer);
+		}
 	}
 }
 
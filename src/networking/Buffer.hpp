@@ -34,6 +34,8 @@ namespace networking {
 			inline int32_t size() {return vector.size();}
 			inline uint8_t& operator[](int32_t id) {return vector[id];}
 			inline void resize(int32_t size) {vector.resize(size);}
+			inline void reserve(int32_t size) {vector.reserve(size);}
+			inline size_t capacity() {return vector.capacity();}
 			inline void append(const void* buffer, int32_t bytes) {
 				vector.insert(vector.end(), (const uint8_t*)buffer,
 						(const uint8_t*)buffer+bytes);
@@ -60,6 +62,7 @@ namespace networking {
 
 		inline void Destroy() {
 			Free(buffer);
+			buffer = NULL;
 		}
 
 		inline void Assure() {
@@ -67,6 +70,22 @@ namespace networking {
 				buffer = Allocate();
 		}
 
+		inline void Reserve(int32_t size) {
+			Assure();
+			buffer.load()->reserve(size);
+		}
+
+		inline size_t Capacity() const {
+			if(buffer == NULL)
+				return 0;
+			return buffer.load()->capacity();
+		}
+
+		inline void Resize(int32_t size) {
+			Assure();
+			buffer.load()->resize(size);
+		}
+
 		inline void Write(uint8_t byte) {
 			Assure();
 			buffer.load()->append(&byte, 1);
@@ -100,6 +119,10 @@ namespace networking {
 			return Data()[id];
 		}
 
+		// Vectors with bigger capacity are shrunk before going back to the
+		// pool, so single big message does not pin memory forever.
+		static const size_t MAX_POOLED_CAPACITY = 64*1024;
+
 	private:
 		static Vector* Allocate();
 		static void Free(Vector* buffer);
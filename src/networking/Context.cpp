@@ -16,16 +16,38 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <string>
+
 #include <libusockets.h>
+#include <openssl/ssl.h>
 
 #include "Context.hpp"
 #include "Loop.hpp"
+#include "Event.hpp"
 
 namespace networking {
 	Socket* Context::InternalConnect(const char* ip, int port) {
 		us_socket_t* us_socket = us_socket_context_connect(ssl, context, ip, port,
 				NULL, 0, sizeof(Socket));
-		return (Socket*)us_socket_ext(ssl, us_socket);
+		if(us_socket == NULL)
+			return NULL;
+		Socket* s = (Socket*)us_socket_ext(ssl, us_socket);
+		s->cold = NULL;
+		s->InternalGetCold()->peerName = std::string(ip) + ":"
+			+ std::to_string(port);
+		return s;
+	}
+
+	Socket* Context::InternalConnectUnix(const char* path) {
+		us_socket_t* us_socket = us_socket_context_connect_unix(ssl, context,
+				path, 0, sizeof(Socket));
+		if(us_socket == NULL)
+			return NULL;
+		Socket* s = (Socket*)us_socket_ext(ssl, us_socket);
+		s->cold = NULL;
+		s->InternalGetCold()->peerName = std::string("unix:") + path;
+		return s;
 	}
 
 	void Context::Destructor() {
@@ -41,32 +63,167 @@ namespace networking {
 		sockets = NULL;
 		delete listenSockets;
 		listenSockets = NULL;
+		delete sessionCache;
+		sessionCache = NULL;
+	}
+
+	void Context::Broadcast(Buffer& message) {
+		loop->PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=Buffer(),
+				.context=this,
+				.listenSocket = NULL,
+				.type=Event::CONTEXT_ALLCAST,
+				.frame=SharedFrame::Make(message)
+				});
+	}
+
+	void Context::Multicast(std::vector<uint64_t> handles, Buffer& message) {
+		loop->PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=Buffer(),
+				.context=this,
+				.listenSocket = NULL,
+				.type=Event::CONTEXT_MULTICAST,
+				.frame=SharedFrame::Make(message),
+				.handles=std::move(handles)
+				});
+	}
+
+	bool Context::Send(uint64_t handle, Buffer& sendBuffer) {
+		if(handle == 0)
+			return false;
+		if(loop->IsLoopThread()) {
+			Socket* socket = GetSocket(handle);
+			if(socket == NULL)
+				return false;
+			socket->InternalSend(sendBuffer);
+			return true;
+		}
+		loop->PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=std::move(sendBuffer),
+				.context=this,
+				.listenSocket = NULL,
+				.type=Event::HANDLE_SEND,
+				.handle=handle
+				});
+		return true;
+	}
+
+	void Context::Send(uint64_t handle, SharedFrame* frame) {
+		frame->Acquire();
+		loop->PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=Buffer(),
+				.context=this,
+				.listenSocket = NULL,
+				.type=Event::HANDLE_SEND_FRAME,
+				.frame=frame,
+				.handle=handle
+				});
+	}
+
+	void Context::Close(uint64_t handle) {
+		loop->PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=Buffer(),
+				.context=this,
+				.listenSocket = NULL,
+				.type=Event::HANDLE_CLOSE,
+				.handle=handle
+				});
+	}
+
+	void Context::InternalBroadcast(SharedFrame* frame) {
+		for(Socket* socket : *sockets)
+			socket->InternalSend(frame);
+	}
+
+	void Context::SetHeartbeat(int intervalSeconds, int maxMissed) {
+		loop->Post([this, intervalSeconds, maxMissed]() {
+				heartbeatInterval = std::max(intervalSeconds, 0);
+				heartbeatMaxMissed = std::clamp(maxMissed, 1,
+						(int)Socket::MAX_MISSED_HEARTBEATS);
+				for(Socket* socket : *sockets)
+					us_socket_timeout(ssl, socket->socket, heartbeatInterval);
+			});
+	}
+
+	uint64_t Context::GetFastestSocket(const std::vector<uint64_t>& handles) {
+		uint64_t best = 0;
+		uint32_t bestRtt = 0;
+		for(uint64_t handle : handles) {
+			Socket* socket = sockets->Get(handle);
+			if(socket == NULL || socket->GetRtt() == 0)
+				continue;
+			if(best == 0 || socket->GetRtt() < bestRtt) {
+				best = handle;
+				bestRtt = socket->GetRtt();
+			}
+		}
+		return best;
+	}
+
+	size_t Context::GetMemoryUsage() const {
+		size_t bytes = 0;
+		for(Socket* socket : *sockets)
+			bytes += socket->GetMemoryUsage();
+		return bytes;
+	}
+
+	SessionStats Context::GetSessionStats() const {
+		if(sessionCache)
+			return sessionCache->GetStats();
+		return SessionStats{0, 0, 0, 0};
 	}
 
 	struct us_listen_socket_t* Context::StartListening(const char* host, int port) {
 		us_listen_socket_t* socket = us_socket_context_listen(ssl, context, host,
 				port, 0, sizeof(Socket));
-		listenSockets->insert(socket);
+		if(socket)
+			listenSockets->insert(socket);
+		return socket;
+	}
+
+	struct us_listen_socket_t* Context::StartListeningUnix(const char* path) {
+		us_listen_socket_t* socket = us_socket_context_listen_unix(ssl, context,
+				path, 0, sizeof(Socket));
+		if(socket)
+			listenSockets->insert(socket);
 		return socket;
 	}
 
-	struct us_socket_t* Context::InternalOnDataSsl(struct us_socket_t* socket,
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnData(struct us_socket_t* socket,
 			char* data, int length) {
-		Socket* s = (Socket*)us_socket_ext(1, socket);
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
 		s->OnData((uint8_t*)data, length);
 		return socket;
 	}
 
-	struct us_socket_t* Context::InternalOnOpenSsl(struct us_socket_t* socket,
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnOpen(struct us_socket_t* socket,
 			int isClient, char* ip, int ipLength) {
-		Socket* s = (Socket*)us_socket_ext(1, socket);
-		s->ssl = 1;
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
+		s->ssl = isSsl;
 		s->socket = socket;
-		s->context = (Context*)us_socket_context_ext(1,
-				us_socket_context(1, socket));
-		s->loop = (Loop*)us_loop_ext(us_socket_context_loop(1,
+		s->context = (Context*)us_socket_context_ext(isSsl,
+				us_socket_context(isSsl, socket));
+		s->loop = (Loop*)us_loop_ext(us_socket_context_loop(isSsl,
 					s->context->context));
 		s->onReceiveMessage = s->context->onReceiveMessage;
+		if(isClient == 0)
+			s->cold = NULL;
+		else if(isSsl && s->cold)
+			s->context->sessionCache->Resume(
+					(SSL*)us_socket_get_native_handle(isSsl, socket),
+					&s->cold->peerName);
 
 		s->OnOpen(ip, ipLength);
 
@@ -76,60 +233,92 @@ namespace networking {
 		return socket;
 	}
 
-	struct us_socket_t* Context::InternalOnEndSsl(struct us_socket_t* socket) {
-		Socket* s = (Socket*)us_socket_ext(1, socket);
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnConnectionError(
+			struct us_socket_t* socket, int code) {
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
+		delete s->cold;
+		s->cold = NULL;
+		return socket;
+	}
+
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnEnd(struct us_socket_t* socket) {
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
 		s->OnEnd();
 		return socket;
 	}
 
-	struct us_socket_t* Context::InternalOnCloseSsl(struct us_socket_t* socket,
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnClose(struct us_socket_t* socket,
 			int code, void* reason) {
-		Socket* s = (Socket*)us_socket_ext(1, socket);
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
 		s->OnClose(code, reason);
 		return socket;
 	}
 
-	struct us_socket_t* Context::InternalOnTimeoutSsl(struct us_socket_t* socket) {
-		Socket* s = (Socket*)us_socket_ext(1, socket);
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnTimeout(struct us_socket_t* socket) {
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
 		s->OnTimeout();
 		return socket;
 	}
 
-	struct us_socket_t* Context::InternalOnWritableSsl(struct us_socket_t* socket) {
-		Socket* s = (Socket*)us_socket_ext(1, socket);
+	template<int isSsl>
+	struct us_socket_t* Context::InternalOnWritable(struct us_socket_t* socket) {
+		Socket* s = (Socket*)us_socket_ext(isSsl, socket);
 		s->OnWritable();
 		return socket;
 	}
 
+	template<int isSsl>
+	void Context::InternalSetCallbacks(us_socket_context_t* context) {
+		us_socket_context_on_open(isSsl, context, Context::InternalOnOpen<isSsl>);
+		us_socket_context_on_data(isSsl, context, Context::InternalOnData<isSsl>);
+		us_socket_context_on_writable(isSsl, context,
+				Context::InternalOnWritable<isSsl>);
+		us_socket_context_on_close(isSsl, context,
+				Context::InternalOnClose<isSsl>);
+		us_socket_context_on_timeout(isSsl, context,
+				Context::InternalOnTimeout<isSsl>);
+		us_socket_context_on_end(isSsl, context, Context::InternalOnEnd<isSsl>);
+		us_socket_context_on_connect_error(isSsl, context,
+				Context::InternalOnConnectionError<isSsl>);
+	}
+
 	Context* Context::Make(Loop* loop,
 			std::function<void(Socket*, int, char*, int)> onNewSocket,
 			std::function<void(Buffer&, Socket*)> onReceiveMessage,
 			const char* keyFileName, const char* certFileName,
 			const char* caFileName, const char* passphrase) {
-		if(keyFileName == NULL || certFileName == NULL || caFileName == NULL) {
+		int ssl = 1;
+		if(keyFileName == NULL && certFileName == NULL && caFileName == NULL) {
+			ssl = 0;
+		} else if(keyFileName == NULL || certFileName == NULL
+				|| caFileName == NULL) {
 			fprintf(stderr,
-					" ERROR: Currently no-ssl tcp sockets are not suported!\n");
+					" ERROR: ssl context requires key, cert and ca files!\n");
 			fflush(stderr);
 			return NULL;
 		}
-		struct us_socket_context_options_t options;
+		struct us_socket_context_options_t options = {};
 		options.cert_file_name = certFileName;
 		options.key_file_name = keyFileName;
 		options.passphrase = passphrase;
 		options.ca_file_name = caFileName;
-		us_socket_context_t* context = us_create_socket_context(1, loop->loop,
+		us_socket_context_t* context = us_create_socket_context(ssl, loop->loop,
 				sizeof(Context), options);
+		if(context == NULL)
+			return NULL;
 
-		us_socket_context_on_open(1, context, Context::InternalOnOpenSsl);
-		us_socket_context_on_data(1, context, Context::InternalOnDataSsl);
-		us_socket_context_on_writable(1, context, Context::InternalOnWritableSsl);
-		us_socket_context_on_close(1, context, Context::InternalOnCloseSsl);
-		us_socket_context_on_timeout(1, context, Context::InternalOnTimeoutSsl);
-		us_socket_context_on_end(1, context, Context::InternalOnEndSsl);
+		if(ssl)
+			InternalSetCallbacks<1>(context);
+		else
+			InternalSetCallbacks<0>(context);
 
-		Context* c = (Context*)us_socket_context_ext(1, context);
+		Context* c = (Context*)us_socket_context_ext(ssl, context);
 
-		c->sockets = new std::set<Socket*>();
+		c->sockets = new SocketTable();
 		c->listenSockets = new std::set<us_listen_socket_t*>();
 
 		c->context = context;
@@ -137,11 +326,17 @@ namespace networking {
 		c->userData = NULL;
 		c->onNewSocket = new decltype(onNewSocket)(onNewSocket);
 		c->onReceiveMessage = new decltype(onReceiveMessage)(onReceiveMessage);
-		c->ssl = 1;
+		c->ssl = ssl;
+		c->sessionCache = NULL;
+		c->heartbeatInterval = 0;
+		c->heartbeatMaxMissed = 1;
+		c->exchangeFunctionTables = false;
+		if(ssl)
+			c->sessionCache = new SessionCache(
+					(SSL_CTX*)us_socket_context_get_native_handle(1, context));
 
 		loop->contexts->insert(c);
 
 		return c;
 	}
 }
-
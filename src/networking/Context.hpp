@@ -20,11 +20,14 @@
 #define DORPC_NETWORKING_CONTEXT_HPP
 
 #include <functional>
+#include <vector>
 #include <set>
 #include <libusockets.h>
 
 #include "Buffer.hpp"
 #include "Socket.hpp"
+#include "SessionCache.hpp"
+#include "SocketTable.hpp"
 
 namespace networking {
 	struct Context {
@@ -34,30 +37,84 @@ namespace networking {
 		std::function<void(Socket*, int, char*, int)> *onNewSocket;
 		std::function<void(Buffer&, Socket*)> *onReceiveMessage;
 		int ssl;
-		std::set<Socket*>* sockets;
+		SocketTable* sockets;
 		std::set<struct us_listen_socket_t*>* listenSockets;
+		SessionCache* sessionCache;
+		// Seconds between heartbeats, 0 disables them.
+		int heartbeatInterval;
+		int heartbeatMaxMissed;
+		bool exchangeFunctionTables;
 
 
 		struct us_listen_socket_t* StartListening(const char* host, int port);
+		struct us_listen_socket_t* StartListeningUnix(const char* path);
 
 		Socket* InternalConnect(const char* ip, int port);
+		Socket* InternalConnectUnix(const char* path);
 
 		void Destructor();
 
+		// Thread safe, message is framed once and shared by all sockets.
+		void Broadcast(Buffer& message);
+		void Multicast(std::vector<uint64_t> handles, Buffer& message);
+		void InternalBroadcast(SharedFrame* frame);
 
-		static struct us_socket_t* InternalOnOpenSsl(struct us_socket_t* socket,
+		// Thread safe, messages to closed sockets are dropped. On loop thread
+		// message is sent immediately and false is returned for stale
+		// handle, other threads learn about it only when loop drops it.
+		bool Send(uint64_t handle, Buffer& sendBuffer);
+		// Thread safe, acquires its own reference to frame.
+		void Send(uint64_t handle, SharedFrame* frame);
+		void Close(uint64_t handle);
+		// Loop thread only, returns NULL for stale handles.
+		inline Socket* GetSocket(uint64_t handle) {
+			return sockets->Get(handle);
+		}
+
+		// Thread safe. Sends a ping every intervalSeconds (rounded up by
+		// uSockets to its timeout granularity) and closes sockets which did not
+		// answer within maxMissed intervals, clamped to 1..255. Sockets with
+		// reading paused by the memory budget are not checked. Applies to
+		// existing sockets too.
+		void SetHeartbeat(int intervalSeconds, int maxMissed);
+		// Loop thread only or before Loop::Run. Every socket opened later
+		// sends rpc::FunctionRegistry::WriteTable as its first message and
+		// reads the first received message into its FunctionTranslation,
+		// see Endpoint::GetFunctionTranslation. Both sides have to enable it.
+		inline void EnableFunctionTranslation() {
+			exchangeFunctionTables = true;
+		}
+		// Loop thread only, returns the handle with lowest measured RTT or 0.
+		uint64_t GetFastestSocket(const std::vector<uint64_t>& handles);
+
+		SessionStats GetSessionStats() const;
+		// Sum of Socket::GetMemoryUsage of all sockets, loop thread only.
+		size_t GetMemoryUsage() const;
+
+
+		template<int isSsl>
+		static struct us_socket_t* InternalOnOpen(struct us_socket_t* socket,
 				int isClient, char* ip, int ipLength);
-		static struct us_socket_t* InternalOnConnectioErrorOpenSsl(
+		template<int isSsl>
+		static struct us_socket_t* InternalOnConnectionError(
 				struct us_socket_t* socket, int code);
-		static struct us_socket_t* InternalOnDataSsl(struct us_socket_t* socket,
+		template<int isSsl>
+		static struct us_socket_t* InternalOnData(struct us_socket_t* socket,
 				char* data, int length);
-		static struct us_socket_t* InternalOnEndSsl(struct us_socket_t* socket);
-		static struct us_socket_t* InternalOnCloseSsl(struct us_socket_t* socket,
+		template<int isSsl>
+		static struct us_socket_t* InternalOnEnd(struct us_socket_t* socket);
+		template<int isSsl>
+		static struct us_socket_t* InternalOnClose(struct us_socket_t* socket,
 				int code, void* reason);
-		static struct us_socket_t* InternalOnTimeoutSsl(struct us_socket_t* socket);
-		static struct us_socket_t* InternalOnWritableSsl(
-				struct us_socket_t* socket);
+		template<int isSsl>
+		static struct us_socket_t* InternalOnTimeout(struct us_socket_t* socket);
+		template<int isSsl>
+		static struct us_socket_t* InternalOnWritable(struct us_socket_t* socket);
+		template<int isSsl>
+		static void InternalSetCallbacks(struct us_socket_context_t* context);
 
+		// Passing NULL key, cert and ca file names creates a context without
+		// TLS, intended for unix domain sockets and trusted networks.
 		static Context* Make(Loop* loop,
 				std::function<void(Socket*, int, char*, int)> onNewSocket,
 				std::function<void(Buffer&, Socket*)> onReceiveMessage,
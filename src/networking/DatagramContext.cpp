@@ -0,0 +1,603 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#include <cstring>
+#include <cstdlib>
+
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include <libusockets.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "Loop.hpp"
+#include "Event.hpp"
+
+#include "DatagramContext.hpp"
+
+namespace networking {
+	namespace impl {
+		static thread_local uint8_t datagramPlainBuffer[1<<16];
+
+		static std::string AddressKey(const struct sockaddr* address) {
+			if(address->sa_family == AF_INET6) {
+				const sockaddr_in6* a = (const sockaddr_in6*)address;
+				return std::string("6") + std::string((const char*)&a->sin6_port,
+						sizeof(a->sin6_port)) + std::string(
+							(const char*)&a->sin6_addr, sizeof(a->sin6_addr));
+			}
+			const sockaddr_in* a = (const sockaddr_in*)address;
+			return std::string("4") + std::string((const char*)&a->sin_port,
+					sizeof(a->sin_port)) + std::string(
+						(const char*)&a->sin_addr, sizeof(a->sin_addr));
+		}
+
+		static int64_t NowMs() {
+			return std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::steady_clock::now().time_since_epoch())
+				.count();
+		}
+
+		static int32_t ReadLength(const uint8_t* data) {
+			return (int(data[0]))
+				| (int(data[1]) << 8)
+				| (int(data[2]) << 16)
+				| (int(data[3]) << 24);
+		}
+
+		static uint8_t cookieSecret[32];
+		static std::once_flag cookieSecretOnce;
+
+		static int GenerateCookie(SSL* ssl, unsigned char* cookie,
+				unsigned int* length) {
+			DatagramContext::Peer* peer =
+				(DatagramContext::Peer*)BIO_get_data(SSL_get_rbio(ssl));
+			std::call_once(cookieSecretOnce, [](){
+					RAND_bytes(cookieSecret, sizeof(cookieSecret));
+				});
+			std::string key = AddressKey((const sockaddr*)&peer->address);
+			return HMAC(EVP_sha256(), cookieSecret, sizeof(cookieSecret),
+					(const unsigned char*)key.data(), key.size(), cookie,
+					length) != NULL;
+		}
+
+		static int VerifyCookie(SSL* ssl, const unsigned char* cookie,
+				unsigned int length) {
+			unsigned char expected[EVP_MAX_MD_SIZE];
+			unsigned int expectedLength = 0;
+			if(GenerateCookie(ssl, expected, &expectedLength) == 0)
+				return 0;
+			return expectedLength == length
+				&& CRYPTO_memcmp(expected, cookie, length) == 0;
+		}
+
+		static int DatagramBioWrite(BIO* bio, const char* data, int length) {
+			DatagramContext::Peer* peer =
+				(DatagramContext::Peer*)BIO_get_data(bio);
+			peer->context->InternalSendDatagram(peer, data, length);
+			return length;
+		}
+
+		static int DatagramBioRead(BIO* bio, char* data, int length) {
+			DatagramContext::Peer* peer =
+				(DatagramContext::Peer*)BIO_get_data(bio);
+			BIO_clear_retry_flags(bio);
+			if(peer->incoming == NULL) {
+				BIO_set_retry_read(bio);
+				return -1;
+			}
+			int bytes = std::min(length, peer->incomingLength);
+			memcpy(data, peer->incoming, bytes);
+			peer->incoming = NULL;
+			return bytes;
+		}
+
+		static long DatagramBioCtrl(BIO* bio, int cmd, long num, void* ptr) {
+			switch(cmd) {
+			case BIO_CTRL_FLUSH:
+				return 1;
+			case BIO_CTRL_DGRAM_QUERY_MTU:
+				return DatagramContext::MAX_DATAGRAM_PAYLOAD;
+			default:
+				return 0;
+			}
+		}
+
+		static int DatagramBioCreate(BIO* bio) {
+			BIO_set_init(bio, 1);
+			return 1;
+		}
+
+		static BIO_METHOD* DatagramBioMethod() {
+			static BIO_METHOD* method = [](){
+				BIO_METHOD* m = BIO_meth_new(
+						BIO_get_new_index() | BIO_TYPE_SOURCE_SINK,
+						"dorpc datagram");
+				BIO_meth_set_write(m, DatagramBioWrite);
+				BIO_meth_set_read(m, DatagramBioRead);
+				BIO_meth_set_ctrl(m, DatagramBioCtrl);
+				BIO_meth_set_create(m, DatagramBioCreate);
+				return m;
+			}();
+			return method;
+		}
+	}
+
+	int DatagramContext::AddPeer(const char* ip, int port) {
+		struct addrinfo hints = {}, *result = NULL;
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_DGRAM;
+		std::string service = std::to_string(port);
+		if(getaddrinfo(ip, service.c_str(), &hints, &result) != 0
+				|| result == NULL)
+			return -1;
+		int peerId = InternalGetPeer(result->ai_addr, true, NULL);
+		freeaddrinfo(result);
+		return peerId;
+	}
+
+	void DatagramContext::RemovePeer(int peerId) {
+		Peer* peer = NULL;
+		{
+			std::lock_guard<std::mutex> lock(*peersMutex);
+			peer = InternalPeer(peerId);
+			if(peer == NULL)
+				return;
+			peerIds->erase(impl::AddressKey((const sockaddr*)&peer->address));
+			(*peers)[peerId] = NULL;
+			freePeerIds->push_back(peerId);
+			--peerCount;
+		}
+		InternalFreePeer(peer);
+	}
+
+	DatagramContext::Peer* DatagramContext::InternalPeer(int peerId) {
+		if(peerId < 0 || peerId >= (int)peers->size())
+			return NULL;
+		return (*peers)[peerId];
+	}
+
+	void DatagramContext::InternalFreePeer(Peer* peer) {
+		if(peer->ssl)
+			SSL_free(peer->ssl);
+		delete peer;
+	}
+
+	void DatagramContext::Send(int peerId, Buffer& sendBuffer) {
+		loop->PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=std::move(sendBuffer),
+				.datagramContext=this,
+				.listenSocket = NULL,
+				.port=peerId,
+				.type=Event::DATAGRAM_SEND
+				});
+	}
+
+	void DatagramContext::InternalSend(int peerId, Buffer& buffer) {
+		Peer* peer = NULL;
+		{
+			std::lock_guard<std::mutex> lock(*peersMutex);
+			peer = InternalPeer(peerId);
+			if(peer == NULL)
+				return;
+		}
+		int32_t length = buffer.Size();
+		int32_t limit = MAX_DATAGRAM_PAYLOAD - (sslContext ? DTLS_OVERHEAD : 0);
+		if(peer->pending.Size() && peer->pending.Size()+4+length > limit) {
+			InternalFlushPeer(peer);
+			// DTLS handshake is still in progress, queue is bounded.
+			if(peer->pending.Size()+4+length > MAX_HANDSHAKE_QUEUE) {
+				++droppedMessages;
+				return;
+			}
+		}
+		uint8_t b[4];
+		b[0] = (length)&0xFF;
+		b[1] = (length>>8)&0xFF;
+		b[2] = (length>>16)&0xFF;
+		b[3] = (length>>24)&0xFF;
+		peer->pending.Write(b, 4);
+		peer->pending.Write(buffer.Data(), length);
+		if(peer->dirty == false) {
+			peer->dirty = true;
+			dirtyPeers->push_back(peerId);
+		}
+		if(batching == false)
+			InternalFlush();
+	}
+
+	void DatagramContext::InternalFlush() {
+		if(dirtyPeers->empty() == false) {
+			std::lock_guard<std::mutex> lock(*peersMutex);
+			// Peers removed meanwhile are skipped.
+			for(int peerId : *dirtyPeers)
+				if(Peer* peer = InternalPeer(peerId))
+					InternalFlushPeer(peer);
+			dirtyPeers->clear();
+		}
+		InternalSendPackets();
+	}
+
+	void DatagramContext::InternalFlushPeer(Peer* peer) {
+		peer->dirty = false;
+		const uint8_t* data = peer->pending.Data();
+		int32_t size = peer->pending.Size();
+		int32_t limit = MAX_DATAGRAM_PAYLOAD - (sslContext ? DTLS_OVERHEAD : 0);
+		int32_t offset = 0;
+		while(offset < size) {
+			// Whole messages are grouped into datagrams of at most limit
+			// bytes, single larger message is sent alone.
+			int32_t end = offset + 4 + impl::ReadLength(data+offset);
+			while(end < size
+					&& end + 4 + impl::ReadLength(data+end) - offset <= limit)
+				end += 4 + impl::ReadLength(data+end);
+			if(peer->ssl) {
+				int r = SSL_write(peer->ssl, data+offset, end-offset);
+				if(r <= 0) {
+					int error = SSL_get_error(peer->ssl, r);
+					ERR_clear_error();
+					// Pending messages are sent after handshake finishes.
+					if(error == SSL_ERROR_WANT_READ
+							|| error == SSL_ERROR_WANT_WRITE)
+						break;
+					InternalResetSsl(peer);
+					offset = size;
+					break;
+				}
+			} else {
+				InternalSendDatagram(peer, data+offset, end-offset);
+			}
+			offset = end;
+		}
+		if(offset == size) {
+			peer->pending.Clear();
+		} else if(offset) {
+			Buffer rest;
+			rest.Write(data+offset, size-offset);
+			peer->pending = std::move(rest);
+		}
+	}
+
+	void DatagramContext::InternalSendDatagram(Peer* peer, const void* data,
+			int length) {
+		us_udp_buffer_set_packet_payload(sendBuffer, packetsToSend, 0,
+				(void*)data, length, &peer->address);
+		++packetsToSend;
+		if(packetsToSend == MAX_PACKETS_PER_SEND)
+			InternalSendPackets();
+	}
+
+	void DatagramContext::InternalSendPackets() {
+		// Datagrams not accepted by the kernel are dropped.
+		if(packetsToSend)
+			us_udp_socket_send(socket, sendBuffer, packetsToSend);
+		packetsToSend = 0;
+	}
+
+	int DatagramContext::InternalFindPeer(const struct sockaddr* address) {
+		std::string key = impl::AddressKey(address);
+		std::lock_guard<std::mutex> lock(*peersMutex);
+		auto it = peerIds->find(key);
+		if(it != peerIds->end())
+			return it->second;
+		return -1;
+	}
+
+	int DatagramContext::InternalGetPeer(const struct sockaddr* address,
+			bool isClient, struct ssl_st* ssl) {
+		std::string key = impl::AddressKey(address);
+		std::lock_guard<std::mutex> lock(*peersMutex);
+		auto it = peerIds->find(key);
+		if(it != peerIds->end() || peerCount >= MAX_PEERS) {
+			if(ssl)
+				SSL_free(ssl);
+			return it != peerIds->end() ? it->second : -1;
+		}
+		Peer* peer = new Peer();
+		peer->context = this;
+		memcpy(&peer->address, address, address->sa_family == AF_INET6 ?
+				sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+		peer->ssl = NULL;
+		peer->incoming = NULL;
+		peer->incomingLength = 0;
+		peer->isClient = isClient;
+		peer->dirty = false;
+		peer->lastReceived = impl::NowMs();
+		if(ssl) {
+			peer->ssl = ssl;
+			BIO_set_data(SSL_get_rbio(ssl), peer);
+		} else {
+			InternalResetSsl(peer);
+		}
+		int peerId = peers->size();
+		if(freePeerIds->empty()) {
+			peers->push_back(peer);
+		} else {
+			peerId = freePeerIds->back();
+			freePeerIds->pop_back();
+			(*peers)[peerId] = peer;
+		}
+		++peerCount;
+		(*peerIds)[key] = peerId;
+		return peerId;
+	}
+
+	void DatagramContext::InternalResetSsl(Peer* peer) {
+		if(peer->ssl)
+			SSL_free(peer->ssl);
+		peer->ssl = NULL;
+		if(sslContext == NULL)
+			return;
+		peer->ssl = SSL_new(sslContext);
+		BIO* bio = BIO_new(impl::DatagramBioMethod());
+		BIO_set_data(bio, peer);
+		SSL_set_bio(peer->ssl, bio, bio);
+		SSL_set_options(peer->ssl, SSL_OP_NO_QUERY_MTU);
+		DTLS_set_link_mtu(peer->ssl, MAX_DATAGRAM_PAYLOAD);
+		if(peer == listener)
+			SSL_set_options(peer->ssl, SSL_OP_COOKIE_EXCHANGE);
+		if(peer->isClient)
+			SSL_set_connect_state(peer->ssl);
+		else
+			SSL_set_accept_state(peer->ssl);
+	}
+
+	int DatagramContext::InternalListen(const struct sockaddr* address,
+			const uint8_t* data, int length) {
+		memcpy(&listener->address, address, address->sa_family == AF_INET6 ?
+				sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+		listener->incoming = data;
+		listener->incomingLength = length;
+		BIO_ADDR* client = BIO_ADDR_new();
+		int r = DTLSv1_listen(listener->ssl, client);
+		BIO_ADDR_free(client);
+		ERR_clear_error();
+		listener->incoming = NULL;
+		if(r == 0)
+			return -1;
+		struct ssl_st* ssl = NULL;
+		if(r > 0) {
+			// Cookie was verified, the session continues with this peer.
+			ssl = listener->ssl;
+			listener->ssl = NULL;
+		}
+		InternalResetSsl(listener);
+		if(ssl == NULL)
+			return -1;
+		return InternalGetPeer(address, false, ssl);
+	}
+
+	void DatagramContext::InternalDeliver(int peerId, const uint8_t* data,
+			int length) {
+		Buffer buffer;
+		while(length >= 4) {
+			int32_t size = impl::ReadLength(data);
+			if(size < 0 || size > length-4)
+				return;
+			buffer.Clear();
+			buffer.Write(data+4, size);
+			if(onReceiveMessage)
+				(*onReceiveMessage)(buffer, this, peerId);
+			data += 4+size;
+			length -= 4+size;
+		}
+	}
+
+	void DatagramContext::InternalReceiveSsl(int peerId, const uint8_t* data,
+			int length) {
+		Peer* peer = NULL;
+		{
+			std::lock_guard<std::mutex> lock(*peersMutex);
+			peer = InternalPeer(peerId);
+		}
+		bool wasFinished = SSL_is_init_finished(peer->ssl);
+		peer->incoming = data;
+		peer->incomingLength = length;
+		for(;;) {
+			int r = SSL_read(peer->ssl, impl::datagramPlainBuffer,
+					sizeof(impl::datagramPlainBuffer));
+			if(r > 0) {
+				InternalDeliver(peerId, impl::datagramPlainBuffer, r);
+				continue;
+			}
+			int error = SSL_get_error(peer->ssl, r);
+			ERR_clear_error();
+			if(error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+				InternalResetSsl(peer);
+			break;
+		}
+		peer->incoming = NULL;
+		if(wasFinished == false && SSL_is_init_finished(peer->ssl))
+			InternalFlushPeer(peer);
+	}
+
+	void DatagramContext::InternalOnData(struct us_udp_socket_t* socket,
+			struct us_udp_packet_buffer_t* buffer, int packets) {
+		DatagramContext* c = (DatagramContext*)us_udp_socket_user(socket);
+		for(int i=0; i<packets; ++i) {
+			const struct sockaddr* address =
+				(const struct sockaddr*)us_udp_packet_buffer_peer(buffer, i);
+			const uint8_t* payload =
+				(const uint8_t*)us_udp_packet_buffer_payload(buffer, i);
+			int length = us_udp_packet_buffer_payload_length(buffer, i);
+			int peerId = c->InternalFindPeer(address);
+			if(peerId < 0) {
+				// Session state of DTLS peer is allocated only after it
+				// answered the cookie exchange.
+				if(c->sslContext) {
+					peerId = c->InternalListen(address, payload, length);
+					if(peerId >= 0)
+						c->InternalReceiveSsl(peerId, NULL, 0);
+					continue;
+				}
+				peerId = c->InternalGetPeer(address, false, NULL);
+				if(peerId < 0)
+					continue;
+			}
+			{
+				std::lock_guard<std::mutex> lock(*c->peersMutex);
+				c->InternalPeer(peerId)->lastReceived = impl::NowMs();
+			}
+			if(c->sslContext)
+				c->InternalReceiveSsl(peerId, payload, length);
+			else
+				c->InternalDeliver(peerId, payload, length);
+		}
+		c->InternalSendPackets();
+	}
+
+	void DatagramContext::InternalOnDrain(struct us_udp_socket_t* socket) {
+	}
+
+	void DatagramContext::InternalOnTimer(struct us_timer_t* timer) {
+		DatagramContext* c = *(DatagramContext**)us_timer_ext(timer);
+		const int64_t now = impl::NowMs();
+		std::vector<int> idle;
+		{
+			std::lock_guard<std::mutex> lock(*c->peersMutex);
+			for(size_t i=0; i<c->peers->size(); ++i) {
+				Peer* peer = (*c->peers)[i];
+				if(peer == NULL)
+					continue;
+				if(peer->isClient == false
+						&& now - peer->lastReceived >= PEER_IDLE_TIMEOUT_MS)
+					idle.push_back(i);
+				else if(peer->ssl && SSL_is_init_finished(peer->ssl) == 0)
+					DTLSv1_handle_timeout(peer->ssl);
+			}
+		}
+		for(int peerId : idle)
+			c->RemovePeer(peerId);
+		c->InternalSendPackets();
+	}
+
+	DatagramContext::~DatagramContext() {
+		loop->datagramContexts->erase(this);
+		if(timer)
+			us_timer_close(timer);
+		if(socket)
+			us_udp_socket_close(socket);
+		free(receiveBuffer);
+		free(sendBuffer);
+		if(listener) {
+			if(listener->ssl)
+				SSL_free(listener->ssl);
+			delete listener;
+		}
+		for(Peer* peer : *peers)
+			if(peer)
+				InternalFreePeer(peer);
+		delete peers;
+		delete freePeerIds;
+		delete peerIds;
+		delete dirtyPeers;
+		delete peersMutex;
+		delete onReceiveMessage;
+		if(sslContext)
+			SSL_CTX_free(sslContext);
+	}
+
+	DatagramContext* DatagramContext::Make(Loop* loop, const char* host,
+			int port,
+			std::function<void(Buffer&, DatagramContext*, int)>
+				onReceiveMessage,
+			const char* keyFileName, const char* certFileName,
+			const char* caFileName, const char* passphrase) {
+		SSL_CTX* sslContext = NULL;
+		if(keyFileName || certFileName || caFileName) {
+			if(keyFileName == NULL || certFileName == NULL
+					|| caFileName == NULL) {
+				fprintf(stderr,
+						" ERROR: dtls context requires key, cert and ca files!\n");
+				fflush(stderr);
+				return NULL;
+			}
+			sslContext = SSL_CTX_new(DTLS_method());
+			SSL_CTX_set_default_passwd_cb_userdata(sslContext,
+					(void*)passphrase);
+			if(SSL_CTX_use_certificate_chain_file(sslContext, certFileName) != 1
+					|| SSL_CTX_use_PrivateKey_file(sslContext, keyFileName,
+						SSL_FILETYPE_PEM) != 1
+					|| SSL_CTX_load_verify_locations(sslContext, caFileName,
+						NULL) != 1) {
+				fprintf(stderr,
+						" ERROR: cannot load dtls certificates!\n");
+				fflush(stderr);
+				SSL_CTX_free(sslContext);
+				return NULL;
+			}
+			SSL_CTX_set_verify(sslContext,
+					SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+			SSL_CTX_set_cookie_generate_cb(sslContext, impl::GenerateCookie);
+			SSL_CTX_set_cookie_verify_cb(sslContext, impl::VerifyCookie);
+		}
+
+		DatagramContext* c = new DatagramContext();
+		c->loop = loop;
+		c->userData = NULL;
+		c->onReceiveMessage = new decltype(onReceiveMessage)(onReceiveMessage);
+		c->sslContext = sslContext;
+		c->batching = true;
+		c->packetsToSend = 0;
+		c->droppedMessages = 0;
+		c->timer = NULL;
+		c->listener = NULL;
+		c->peersMutex = new std::mutex();
+		c->peers = new std::vector<Peer*>();
+		c->freePeerIds = new std::vector<int>();
+		c->peerCount = 0;
+		c->peerIds = new std::unordered_map<std::string, int>();
+		c->dirtyPeers = new std::vector<int>();
+		c->receiveBuffer = us_create_udp_packet_buffer();
+		c->sendBuffer = us_create_udp_packet_buffer();
+		c->socket = us_create_udp_socket(loop->loop, c->receiveBuffer,
+				DatagramContext::InternalOnData, DatagramContext::InternalOnDrain,
+				host, port, c);
+		loop->datagramContexts->insert(c);
+		if(c->socket == NULL) {
+			delete c;
+			return NULL;
+		}
+		if(sslContext) {
+			c->listener = new Peer();
+			c->listener->context = c;
+			c->listener->ssl = NULL;
+			c->listener->incoming = NULL;
+			c->listener->incomingLength = 0;
+			c->listener->isClient = false;
+			c->listener->dirty = false;
+			c->InternalResetSsl(c->listener);
+		}
+		// Drives DTLS retransmissions and expiry of idle peers.
+		c->timer = us_create_timer(loop->loop, 0, sizeof(DatagramContext*));
+		*(DatagramContext**)us_timer_ext(c->timer) = c;
+		us_timer_set(c->timer, DatagramContext::InternalOnTimer, TIMER_MS,
+				TIMER_MS);
+		return c;
+	}
+}
+
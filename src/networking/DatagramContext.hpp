@@ -0,0 +1,151 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_DATAGRAM_CONTEXT_HPP
+#define DORPC_NETWORKING_DATAGRAM_CONTEXT_HPP
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include <sys/socket.h>
+
+#include <libusockets.h>
+
+#include "Buffer.hpp"
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+namespace networking {
+	/*
+	 * Connectionless transport over UDP. Messages use the same 4 byte length
+	 * framing as Socket, but many of them may be packed into one datagram.
+	 * Messages queued during one loop iteration are flushed in Loop::OnPost,
+	 * or immediately when batching is disabled. Delivery is not guaranteed.
+	 *
+	 * When created with certificates, every peer gets its own DTLS session.
+	 * Peer added with AddPeer acts as DTLS client, peer first seen by
+	 * receiving datagram acts as DTLS server. Unknown sources have to answer
+	 * a stateless cookie exchange before any peer state is allocated for
+	 * them. Messages sent before the handshake finishes are queued, up to
+	 * MAX_HANDSHAKE_QUEUE bytes per peer.
+	 *
+	 * At most MAX_PEERS peers are kept, datagrams from further sources are
+	 * ignored. Peers first seen by receiving datagram are removed after
+	 * PEER_IDLE_TIMEOUT_MS without any datagram from them, peers added with
+	 * AddPeer only by RemovePeer. Ids of removed peers are reused. Must be
+	 * destroyed on the loop thread.
+	 */
+	struct DatagramContext {
+		struct Peer {
+			struct DatagramContext* context;
+			struct sockaddr_storage address;
+			Buffer pending;
+			struct ssl_st* ssl;
+			const uint8_t* incoming;
+			int incomingLength;
+			bool isClient;
+			bool dirty;
+			// Milliseconds of steady clock.
+			int64_t lastReceived;
+		};
+
+		static const int MAX_DATAGRAM_PAYLOAD = 1400;
+		static const int MAX_PACKETS_PER_SEND = 64;
+		static const int DTLS_OVERHEAD = 128;
+		static const int MAX_PEERS = 4096;
+		static const int MAX_HANDSHAKE_QUEUE = 1<<18;
+		static const int PEER_IDLE_TIMEOUT_MS = 60000;
+		static const int TIMER_MS = 100;
+
+		struct us_udp_socket_t* socket;
+		struct us_udp_packet_buffer_t* receiveBuffer;
+		struct us_udp_packet_buffer_t* sendBuffer;
+		struct us_timer_t* timer;
+		struct Loop* loop;
+		void* userData;
+		std::function<void(Buffer&, DatagramContext*, int)> *onReceiveMessage;
+		struct ssl_ctx_st* sslContext;
+		bool batching;
+		int packetsToSend;
+		// Messages dropped because handshake queue was full.
+		uint64_t droppedMessages;
+
+		std::mutex* peersMutex;
+		// Removed peers leave NULL slots, reused through freePeerIds.
+		std::vector<Peer*>* peers;
+		std::vector<int>* freePeerIds;
+		int peerCount;
+		std::unordered_map<std::string, int>* peerIds;
+		std::vector<int>* dirtyPeers;
+		Peer* listener;
+
+
+		// Thread safe. Returns peer id used by Send and passed to
+		// onReceiveMessage, or -1 when address cannot be resolved or peer
+		// limit is reached.
+		int AddPeer(const char* ip, int port);
+		// Loop thread only, drops peer with its session and queued messages.
+		void RemovePeer(int peerId);
+
+		// Thread safe, takes ownership of sendBuffer contents.
+		void Send(int peerId, Buffer& sendBuffer);
+
+		void InternalSend(int peerId, Buffer& buffer);
+		void InternalFlush();
+		void InternalSendDatagram(Peer* peer, const void* data, int length);
+		void InternalSendPackets();
+
+		~DatagramContext();
+
+
+		static void InternalOnData(struct us_udp_socket_t* socket,
+				struct us_udp_packet_buffer_t* buffer, int packets);
+		static void InternalOnDrain(struct us_udp_socket_t* socket);
+		static void InternalOnTimer(struct us_timer_t* timer);
+
+		// Passing NULL key, cert and ca file names creates plain UDP context.
+		static DatagramContext* Make(Loop* loop, const char* host, int port,
+				std::function<void(Buffer&, DatagramContext*, int)>
+					onReceiveMessage,
+				const char* keyFileName, const char* certFileName,
+				const char* caFileName, const char* passphrase);
+
+	private:
+
+		DatagramContext() = default;
+
+		int InternalFindPeer(const struct sockaddr* address);
+		Peer* InternalPeer(int peerId);
+		void InternalFreePeer(Peer* peer);
+		int InternalGetPeer(const struct sockaddr* address, bool isClient,
+				struct ssl_st* ssl);
+		int InternalListen(const struct sockaddr* address,
+				const uint8_t* data, int length);
+		void InternalResetSsl(Peer* peer);
+		void InternalDeliver(int peerId, const uint8_t* data, int length);
+		void InternalFlushPeer(Peer* peer);
+		void InternalReceiveSsl(int peerId, const uint8_t* data, int length);
+	};
+}
+
+#endif
+
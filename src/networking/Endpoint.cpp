@@ -0,0 +1,49 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Context.hpp"
+#include "Socket.hpp"
+#include "SharedMemoryChannel.hpp"
+
+#include "Endpoint.hpp"
+
+namespace networking {
+	Endpoint::Endpoint(Socket* socket) : context(socket->context),
+			handle(socket->handle), channel(NULL) {
+	}
+
+	bool Endpoint::Send(Buffer& message) {
+		if(context)
+			return context->Send(handle, message);
+		if(channel)
+			return channel->Send(message);
+		return false;
+	}
+
+	Socket* Endpoint::GetSocket() const {
+		if(context)
+			return context->GetSocket(handle);
+		return NULL;
+	}
+
+	const rpc::FunctionTranslation* Endpoint::GetFunctionTranslation() const {
+		Socket* socket = GetSocket();
+		return socket ? socket->GetFunctionTranslation() : NULL;
+	}
+}
+
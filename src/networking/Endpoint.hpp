@@ -0,0 +1,70 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_ENDPOINT_HPP
+#define DORPC_NETWORKING_ENDPOINT_HPP
+
+#include "Buffer.hpp"
+
+namespace rpc {
+	class FunctionTranslation;
+}
+
+namespace networking {
+	struct Context;
+	struct Socket;
+	class SharedMemoryChannel;
+
+	/*
+	 * Transport independent origin of a received message. Implicitly made
+	 * from Socket* and SharedMemoryChannel*, so one handler taking
+	 * (Buffer&, Endpoint) can be passed to Context::Make and to
+	 * SharedMemoryChannel alike. Socket is referenced by its handle only, so
+	 * endpoint may outlive the socket.
+	 */
+	class Endpoint {
+	public:
+
+		// Loop thread only, socket must be alive.
+		Endpoint(Socket* socket);
+		Endpoint(SharedMemoryChannel* channel) : context(NULL), handle(0),
+			channel(channel) {}
+
+		// Thread safe, takes ownership of message contents. Returns false
+		// when socket is known to be closed, see Context::Send.
+		bool Send(Buffer& message);
+
+		// Loop thread only, NULL when socket was closed.
+		Socket* GetSocket() const;
+		inline Context* GetContext() const { return context; }
+		inline uint64_t GetHandle() const { return handle; }
+		inline SharedMemoryChannel* GetChannel() const { return channel; }
+		// Loop thread only, NULL for shared memory channels, closed sockets
+		// and contexts without function translation.
+		const rpc::FunctionTranslation* GetFunctionTranslation() const;
+
+	private:
+
+		Context* context;
+		uint64_t handle;
+		SharedMemoryChannel* channel;
+	};
+}
+
+#endif
+
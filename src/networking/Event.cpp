@@ -24,6 +24,7 @@
 #include "Socket.hpp"
 #include "Loop.hpp"
 #include "Context.hpp"
+#include "DatagramContext.hpp"
 
 #include "Event.hpp"
 
@@ -37,6 +38,9 @@ namespace networking {
 		case LISTEN_SOCKET_START:
 			context->StartListening((const char*)buffer_or_ip.Data(), port);
 			break;
+		case LISTEN_UNIX_SOCKET_START:
+			context->StartListeningUnix((const char*)buffer_or_ip.Data());
+			break;
 		case LISTEN_SOCKET_STOP:
 			context->listenSockets->erase(listenSocket);
 			us_listen_socket_close(context->ssl, listenSocket);
@@ -45,25 +49,65 @@ namespace networking {
 		case SOCKET_CONNECT:
 			context->InternalConnect((char*)buffer_or_ip.Data(), port);
 			break;
+		case UNIX_SOCKET_CONNECT:
+			context->InternalConnectUnix((char*)buffer_or_ip.Data());
+			break;
 		case SOCKET_CLOSE:
 			socket->InternalClose();
 			break;
-		case SOCKET_SEND:
-			socket->InternalSend(buffer_or_ip);
+
+		case HANDLE_SEND:
+			if(Socket* s = context->GetSocket(handle))
+				s->InternalSend(buffer_or_ip);
+			break;
+		case HANDLE_SEND_FRAME:
+			if(Socket* s = context->GetSocket(handle))
+				s->InternalSend(frame);
+			break;
+		case HANDLE_CLOSE:
+			if(Socket* s = context->GetSocket(handle))
+				s->InternalClose();
+			break;
+
+		case DATAGRAM_SEND:
+			datagramContext->InternalSend(port, buffer_or_ip);
+			break;
+
+		case CONTEXT_ALLCAST:
+			context->InternalBroadcast(frame);
+			break;
+		case CONTEXT_MULTICAST:
+			for(uint64_t h : handles)
+				if(Socket* s = context->GetSocket(h))
+					s->InternalSend(frame);
+			handles.clear();
+			break;
+		case ALLCAST:
+			loop->InternalBroadcast(frame);
+			break;
+		case MULTICAST:
+			for(auto& target : targets)
+				if(Socket* s = target.first->GetSocket(target.second))
+					s->InternalSend(frame);
+			targets.clear();
 			break;
 
 		default:
 			break;
 		}
+		if(frame) {
+			frame->Release();
+			frame = NULL;
+		}
 		if(after)
 			after(*this);
 	}
 
-	Event* Allocate() {
+	Event* Event::Allocate() {
 		return impl::eventPool.acquire();
 	}
 
-	void Free(Event* event) {
+	void Event::Free(Event* event) {
 		if(event)
 			impl::eventPool.release(event);
 	}
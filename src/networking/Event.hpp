@@ -20,10 +20,12 @@
 #define DORPC_NETWORKING_EVENT_HPP
 
 #include <functional>
+#include <vector>
 
 #include <concurrent.hpp>
 
 #include "Buffer.hpp"
+#include "SharedFrame.hpp"
 
 namespace networking {
 	class Event : public concurrent::node<Event> {
@@ -37,17 +39,26 @@ namespace networking {
 			NONE,
 
 			LISTEN_SOCKET_START,
+			LISTEN_UNIX_SOCKET_START,
 			LISTEN_SOCKET_STOP,
 
 			SOCKET_CONNECT,
+			UNIX_SOCKET_CONNECT,
 			// SOCKET_RECONNECT,
 			SOCKET_CLOSE,
-			SOCKET_SEND,
+
+			HANDLE_SEND,
+			HANDLE_SEND_FRAME,
+			HANDLE_CLOSE,
+
+			DATAGRAM_SEND,
 
 			// LOOP_CLOSE,
 
-			// ALLCAST,
-			// MULTICAST
+			CONTEXT_ALLCAST,
+			CONTEXT_MULTICAST,
+			ALLCAST,
+			MULTICAST
 		};
 
 		std::function<void(Event&)> after;
@@ -56,10 +67,15 @@ namespace networking {
 			struct Socket* socket;
 			struct Context* context;
 			struct Loop* loop;
+			struct DatagramContext* datagramContext;
 		};
 		struct us_listen_socket_t* listenSocket;
 		int port;
 		Type type;
+		SharedFrame* frame;
+		std::vector<std::pair<struct Context*, uint64_t>> targets;
+		std::vector<uint64_t> handles;
+		uint64_t handle;
 	};
 }
 
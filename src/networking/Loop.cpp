@@ -16,35 +16,243 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <new>
+
 #include <libusockets.h>
 
+#include "Context.hpp"
+#include "DatagramContext.hpp"
+
 #include "Loop.hpp"
 
 namespace networking {
+	namespace impl {
+		struct TimerData {
+			Loop* loop;
+			uint64_t id;
+			std::function<void()>* callback;
+			bool repeat;
+			bool running;
+			bool cancelled;
+		};
+	}
+
 	void Loop::InternalDestructor() {
+		// Pending events and tasks are freed without running, tasks still
+		// own callbacks of timers which did not start yet.
+		Event* event;
+		while((event = events->pop()) != NULL) {
+			if(event->frame)
+				event->frame->Release();
+			delete event;
+		}
+		Task* task;
+		while((task = tasks->pop()) != NULL)
+			Task::Free(task);
+		while(timers->empty() == false)
+			InternalCloseTimer(timers->begin()->second);
+		delete timers;
+		timers = NULL;
+		// Contexts may be already destroyed, so paused sockets are not
+		// resumed.
+		if(memoryBudget)
+			memoryBudget->Detach(this);
+		memoryBudget = NULL;
+		delete pausedSockets;
+		pausedSockets = NULL;
+		delete chargedSockets;
+		chargedSockets = NULL;
 		delete events;
 		events = NULL;
+		delete tasks;
+		tasks = NULL;
 		delete contexts;
 		contexts = NULL;
+		delete datagramContexts;
+		datagramContexts = NULL;
 		us_loop_free(loop);
 	}
 
 	void Loop::Run() {
+		runningThread = std::this_thread::get_id();
 		us_loop_run(loop);
+		runningThread = std::thread::id();
+	}
+
+	void Loop::Broadcast(Buffer& message) {
+		PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=Buffer(),
+				.loop=this,
+				.listenSocket = NULL,
+				.type=Event::ALLCAST,
+				.frame=SharedFrame::Make(message)
+				});
+	}
+
+	void Loop::Multicast(std::vector<std::pair<Context*, uint64_t>> targets,
+			Buffer& message) {
+		PushEvent(
+				new Event {
+				.after = NULL,
+				.buffer_or_ip=Buffer(),
+				.loop=this,
+				.listenSocket = NULL,
+				.type=Event::MULTICAST,
+				.frame=SharedFrame::Make(message),
+				.targets=std::move(targets)
+				});
+	}
+
+	void Loop::InternalBroadcast(SharedFrame* frame) {
+		for(Context* context : *contexts)
+			context->InternalBroadcast(frame);
+	}
+
+	void Loop::SetMemoryBudget(MemoryBudget* budget) {
+		InternalResumeReading();
+		if(memoryBudget)
+			memoryBudget->Detach(this);
+		memoryBudget = budget;
+		if(memoryBudget)
+			memoryBudget->Attach(this);
+		else if(chargedSockets)
+			chargedSockets->clear();
+	}
+
+	void Loop::InternalAccount(int64_t bytes) {
+		if(memoryBudget == NULL || bytes == 0)
+			return;
+		if(bytes > 0) {
+			if(memoryBudget->Add(bytes))
+				budgetCheckPending = true;
+		} else {
+			memoryBudget->Release(-bytes);
+		}
+	}
+
+	void Loop::InternalPauseHeaviest() {
+		budgetCheckPending = false;
+		if(memoryBudget == NULL || memoryBudget->IsOverLimit() == false)
+			return;
+		std::vector<Socket*> candidates;
+		for(Socket* socket : *chargedSockets)
+			if(socket->readingPaused == 0)
+				candidates.push_back(socket);
+		std::sort(candidates.begin(), candidates.end(),
+				[](Socket* a, Socket* b) {
+					return a->accountedBytes > b->accountedBytes;
+				});
+		int64_t toFree = memoryBudget->GetUsed()
+			- memoryBudget->GetLowWater();
+		for(Socket* socket : candidates) {
+			if(toFree <= 0)
+				break;
+			socket->InternalPauseReading();
+			pausedSockets->emplace_back(socket->context, socket->handle);
+			toFree -= socket->accountedBytes;
+		}
+	}
+
+	void Loop::InternalResumeReading() {
+		for(auto& it : *pausedSockets)
+			if(Socket* socket = it.first->GetSocket(it.second))
+				socket->InternalResumeReading();
+		pausedSockets->clear();
+	}
+
+	uint64_t Loop::ScheduleAfter(int ms, std::function<void()> callback) {
+		return InternalSchedule(ms, false, std::move(callback));
+	}
+
+	uint64_t Loop::ScheduleEvery(int ms, std::function<void()> callback) {
+		return InternalSchedule(ms, true, std::move(callback));
+	}
+
+	void Loop::CancelTimer(uint64_t timer) {
+		Post([this, timer]() {
+				InternalCancelTimer(timer);
+			});
+	}
+
+	uint64_t Loop::InternalSchedule(int ms, bool repeat,
+			std::function<void()> callback) {
+		uint64_t id = ++timersCounter;
+		Post([this, id, ms, repeat, callback=std::move(callback)]() mutable {
+				InternalStartTimer(id, ms, repeat,
+						new std::function<void()>(std::move(callback)));
+			});
+		return id;
+	}
+
+	void Loop::InternalStartTimer(uint64_t id, int ms, bool repeat,
+			std::function<void()>* callback) {
+		struct us_timer_t* timer = us_create_timer(loop, 0,
+				sizeof(impl::TimerData));
+		impl::TimerData* data = (impl::TimerData*)us_timer_ext(timer);
+		*data = impl::TimerData{this, id, callback, repeat, false, false};
+		(*timers)[id] = timer;
+		// uSockets treats 0 as disarmed timer.
+		ms = std::max(ms, 1);
+		us_timer_set(timer, Loop::InternalOnTimer, ms, repeat ? ms : 0);
+	}
+
+	void Loop::InternalCancelTimer(uint64_t id) {
+		auto it = timers->find(id);
+		if(it == timers->end())
+			return;
+		impl::TimerData* data = (impl::TimerData*)us_timer_ext(it->second);
+		if(data->running)
+			data->cancelled = true;
+		else
+			InternalCloseTimer(it->second);
+	}
+
+	void Loop::InternalCloseTimer(struct us_timer_t* timer) {
+		impl::TimerData* data = (impl::TimerData*)us_timer_ext(timer);
+		timers->erase(data->id);
+		delete data->callback;
+		data->callback = NULL;
+		us_timer_close(timer);
+	}
+
+	void Loop::InternalOnTimer(struct us_timer_t* timer) {
+		impl::TimerData* data = (impl::TimerData*)us_timer_ext(timer);
+		data->running = true;
+		(*data->callback)();
+		data->running = false;
+		if(data->repeat == false || data->cancelled)
+			data->loop->InternalCloseTimer(timer);
+	}
+
+	void Loop::PushTask(Task* task) {
+		tasks->push(task);
+		InternalWakeup();
 	}
 
 	void Loop::PushEvent(Event* event) {
 		events->push(event);
-		us_wakeup_loop(loop);
+		InternalWakeup();
+	}
+
+	void Loop::InternalWakeup() {
+		if(wakeupPending.exchange(true, std::memory_order_acq_rel) == false)
+			us_wakeup_loop(loop);
 	}
 
 	void Loop::PopEvents() {
+		wakeupPending.store(false, std::memory_order_seq_cst);
 		Event* event;
 		while((event = events->pop()) != NULL) {
-			if(event)
-				event->Run();
-			else
-				break;
+			event->Run();
+			delete event;
+		}
+		Task* task;
+		while((task = tasks->pop()) != NULL) {
+			task->Run();
+			Task::Free(task);
 		}
 	}
 
@@ -58,6 +266,13 @@ namespace networking {
 
 	void Loop::OnPost() {
 		PopEvents();
+		for(DatagramContext* context : *datagramContexts)
+			context->InternalFlush();
+		if(budgetCheckPending)
+			InternalPauseHeaviest();
+		else if(pausedSockets->empty() == false
+				&& memoryBudget->IsUnderLowWater())
+			InternalResumeReading();
 	}
 
 	void Loop::InternalOnWakeup(struct us_loop_t* loop) {
@@ -79,7 +294,17 @@ namespace networking {
 		loop->loop = us_loop;
 		loop->userData = NULL;
 		loop->events = new concurrent::mpsc::queue<Event>();
+		loop->tasks = new concurrent::mpsc::queue<Task>();
+		new (&loop->wakeupPending) std::atomic<bool>(false);
+		loop->timers = new std::unordered_map<uint64_t, struct us_timer_t*>();
+		new (&loop->timersCounter) std::atomic<uint64_t>(0);
 		loop->contexts = new std::set<Context*>();
+		loop->datagramContexts = new std::set<DatagramContext*>();
+		loop->memoryBudget = NULL;
+		loop->pausedSockets = new std::vector<std::pair<Context*, uint64_t>>();
+		loop->chargedSockets = new std::unordered_set<Socket*>();
+		loop->budgetCheckPending = false;
+		new (&loop->runningThread) std::atomic<std::thread::id>();
 		return loop;
 	}
 }
@@ -20,9 +20,19 @@
 #define DORPC_NETWORKING_LOOP_HPP
 
 #include <mpsc_queue.hpp>
+#include <atomic>
 #include <set>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 #include "Event.hpp"
+#include "Task.hpp"
+#include "MemoryBudget.hpp"
 
 namespace networking {
 	struct Loop {
@@ -30,16 +40,77 @@ namespace networking {
 		void * userData;
 
 		concurrent::mpsc::queue<Event> *events;
+		concurrent::mpsc::queue<Task> *tasks;
+		std::atomic<bool> wakeupPending;
+
+		std::unordered_map<uint64_t, struct us_timer_t*> *timers;
+		std::atomic<uint64_t> timersCounter;
 		std::set<Context*> *contexts;
+		std::set<struct DatagramContext*> *datagramContexts;
+
+		MemoryBudget* memoryBudget;
+		std::vector<std::pair<Context*, uint64_t>> *pausedSockets;
+		// Sockets with accountedBytes > 0 while memoryBudget is set.
+		std::unordered_set<struct Socket*> *chargedSockets;
+		bool budgetCheckPending;
+		// Thread inside Run.
+		std::atomic<std::thread::id> runningThread;
 
 
 		void InternalDestructor();
 
 		void Run();
+		inline bool IsLoopThread() const {
+			return runningThread.load(std::memory_order_relaxed)
+				== std::this_thread::get_id();
+		}
+
+
+		// Thread safe, message is framed once and shared by all sockets of all
+		// contexts of this loop, or by given (context, handle) targets.
+		// Targets closed in the meantime are skipped.
+		void Broadcast(Buffer& message);
+		void Multicast(std::vector<std::pair<Context*, uint64_t>> targets,
+				Buffer& message);
+		void InternalBroadcast(SharedFrame* frame);
+
+
+		// Loop thread only, NULL removes the limit. The same budget may be set
+		// on many loops.
+		void SetMemoryBudget(MemoryBudget* budget);
+		void InternalAccount(int64_t bytes);
+		void InternalPauseHeaviest();
+		void InternalResumeReading();
 
 
+		// Thread safe, runs callable on loop thread. Tasks are executed in
+		// order of posting, but are not ordered with events.
+		template<typename F>
+		void Post(F&& callable);
+		// Thread safe, posts all callables with single loop wakeup. Takes
+		// rvalue container only, callables are moved out of it.
+		template<typename Container>
+		void PostBatch(Container&& callables);
+		void PushTask(Task* task);
+
+
+		// Thread safe, callbacks run on loop thread. Returned handle is never
+		// 0 and may be passed to CancelTimer.
+		uint64_t ScheduleAfter(int ms, std::function<void()> callback);
+		uint64_t ScheduleEvery(int ms, std::function<void()> callback);
+		void CancelTimer(uint64_t timer);
+
+		uint64_t InternalSchedule(int ms, bool repeat,
+				std::function<void()> callback);
+		void InternalStartTimer(uint64_t id, int ms, bool repeat,
+				std::function<void()>* callback);
+		void InternalCancelTimer(uint64_t id);
+		void InternalCloseTimer(struct us_timer_t* timer);
+		static void InternalOnTimer(struct us_timer_t* timer);
+
 		void PushEvent(Event* event);
 		void PopEvents();
+		void InternalWakeup();
 
 		void OnWakeup();
 		void OnPre();
@@ -51,6 +122,21 @@ namespace networking {
 
 		static Loop* Make();
 	};
+
+	template<typename F>
+	inline void Loop::Post(F&& callable) {
+		tasks->push(Task::Make(std::forward<F>(callable)));
+		InternalWakeup();
+	}
+
+	template<typename Container>
+	inline void Loop::PostBatch(Container&& callables) {
+		static_assert(std::is_rvalue_reference_v<Container&&>,
+				"PostBatch moves callables out, pass container with std::move");
+		for(auto& callable : callables)
+			tasks->push(Task::Make(std::move(callable)));
+		InternalWakeup();
+	}
 }
 
 #endif
@@ -0,0 +1,52 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <libusockets.h>
+
+#include "Loop.hpp"
+
+#include "MemoryBudget.hpp"
+
+namespace networking {
+	MemoryBudget::MemoryBudget(int64_t limit, int64_t lowWater) :
+		used(0), limit(limit), lowWater(std::min(limit, lowWater)) {
+	}
+
+	void MemoryBudget::Release(int64_t bytes) {
+		int64_t after = used.fetch_sub(bytes, std::memory_order_relaxed)
+			- bytes;
+		if(after <= lowWater && after + bytes > lowWater) {
+			std::lock_guard<std::mutex> lock(mutex);
+			for(Loop* loop : loops)
+				us_wakeup_loop(loop->loop);
+		}
+	}
+
+	void MemoryBudget::Attach(Loop* loop) {
+		std::lock_guard<std::mutex> lock(mutex);
+		loops.push_back(loop);
+	}
+
+	void MemoryBudget::Detach(Loop* loop) {
+		std::lock_guard<std::mutex> lock(mutex);
+		loops.erase(std::remove(loops.begin(), loops.end(), loop), loops.end());
+	}
+}
+
@@ -0,0 +1,71 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_MEMORY_BUDGET_HPP
+#define DORPC_NETWORKING_MEMORY_BUDGET_HPP
+
+#include <cinttypes>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace networking {
+	/*
+	 * Limit of bytes held by partially received messages and queued outbound
+	 * frames. One budget may be shared by many loops to get process wide
+	 * limit. When usage exceeds limit, loops pause reading on their heaviest
+	 * sockets; reading is resumed when usage drops to lowWater. Socket in
+	 * the middle of a frame keeps reading until the frame is complete, and
+	 * socket announcing a frame bigger than limit is closed.
+	 */
+	class MemoryBudget {
+	public:
+
+		MemoryBudget(int64_t limit, int64_t lowWater);
+
+		// Returns true when usage exceeds limit.
+		inline bool Add(int64_t bytes) {
+			return used.fetch_add(bytes, std::memory_order_relaxed) + bytes
+				> limit;
+		}
+
+		// Wakes attached loops when usage falls to lowWater.
+		void Release(int64_t bytes);
+
+		inline int64_t GetUsed() const { return used; }
+		inline int64_t GetLimit() const { return limit; }
+		inline int64_t GetLowWater() const { return lowWater; }
+		inline bool IsOverLimit() const { return used > limit; }
+		inline bool IsUnderLowWater() const { return used <= lowWater; }
+
+		void Attach(struct Loop* loop);
+		void Detach(struct Loop* loop);
+
+	private:
+
+		std::atomic<int64_t> used;
+		const int64_t limit;
+		const int64_t lowWater;
+
+		std::mutex mutex;
+		std::vector<struct Loop*> loops;
+	};
+}
+
+#endif
+
@@ -0,0 +1,150 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <mutex>
+
+#include "Context.hpp"
+#include "Socket.hpp"
+
+#include "Router.hpp"
+
+namespace networking {
+	Router::Router() : localNode(0), forwarded(0), dropped(0) {
+	}
+
+	void Router::SetLocalNode(uint32_t node) {
+		localNode = node;
+	}
+
+	uint32_t Router::GetLocalNode() const {
+		return localNode;
+	}
+
+	void Router::SetRoute(uint32_t node, Context* context, uint64_t handle) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		routes[node] = Hop{context, handle};
+	}
+
+	void Router::RemoveRoute(uint32_t node) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		routes.erase(node);
+	}
+
+	void Router::RemoveRoutesVia(Context* context, uint64_t handle) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		for(auto it = routes.begin(); it != routes.end();) {
+			if(it->second.context == context && it->second.handle == handle)
+				it = routes.erase(it);
+			else
+				++it;
+		}
+	}
+
+	bool Router::GetRoute(uint32_t node, Context*& context,
+			uint64_t& handle) const {
+		Hop hop;
+		if(InternalFindHop(node, hop) == false)
+			return false;
+		context = hop.context;
+		handle = hop.handle;
+		return true;
+	}
+
+	bool Router::InternalFindHop(uint32_t node, Hop& hop) const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto it = routes.find(node);
+		if(it == routes.end()) {
+			it = routes.find(0);
+			if(it == routes.end())
+				return false;
+		}
+		hop = it->second;
+		return true;
+	}
+
+	void Router::WriteHeader(Buffer& message, uint32_t destination,
+			uint8_t ttl, uint8_t flags) {
+		uint8_t b[HEADER_SIZE];
+		b[0] = (destination)&0xFF;
+		b[1] = (destination>>8)&0xFF;
+		b[2] = (destination>>16)&0xFF;
+		b[3] = (destination>>24)&0xFF;
+		b[4] = ttl;
+		b[5] = flags;
+		b[6] = 0;
+		b[7] = 0;
+		message.Write(b, HEADER_SIZE);
+	}
+
+	bool Router::ReadHeader(const Buffer& message, Header& header) {
+		if(message.Size() < HEADER_SIZE)
+			return false;
+		const uint8_t* b = message.Data();
+		header.destination = ((uint32_t)b[0]) | (((uint32_t)b[1])<<8)
+			| (((uint32_t)b[2])<<16) | (((uint32_t)b[3])<<24);
+		header.ttl = b[4];
+		header.flags = b[5];
+		return true;
+	}
+
+	bool Router::Send(Buffer& message) {
+		Header header;
+		Hop hop;
+		if(ReadHeader(message, header) == false
+				|| InternalFindHop(header.destination, hop) == false) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		if(hop.context->Send(hop.handle, message))
+			return true;
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	Router::Result Router::OnMessage(Buffer& message, Socket* socket) {
+		Header header;
+		if(ReadHeader(message, header) == false) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return DROPPED;
+		}
+		if(header.destination == 0 || header.destination == localNode)
+			return DELIVER;
+		Hop hop;
+		if(header.ttl <= 1
+				|| InternalFindHop(header.destination, hop) == false) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return DROPPED;
+		}
+		// TTL is the only byte changed, in place.
+		message.Data()[4] = header.ttl - 1;
+		if(hop.context->loop == socket->loop) {
+			Socket* next = hop.context->GetSocket(hop.handle);
+			if(next == NULL) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return DROPPED;
+			}
+			next->InternalSend(message);
+			message.Destroy();
+		} else {
+			hop.context->Send(hop.handle, message);
+		}
+		forwarded.fetch_add(1, std::memory_order_relaxed);
+		return FORWARDED;
+	}
+}
+
@@ -0,0 +1,115 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_ROUTER_HPP
+#define DORPC_NETWORKING_ROUTER_HPP
+
+#include <cinttypes>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "Buffer.hpp"
+
+namespace networking {
+	struct Context;
+	struct Socket;
+
+	/*
+	 * Routes messages between nodes which are not directly connected. Every
+	 * routed message starts with HEADER_SIZE bytes: destination node (4 bytes,
+	 * little endian), TTL, flags and 2 reserved bytes. Intermediate nodes read
+	 * only the header and relay the received buffer itself, payload is never
+	 * deserialized nor copied. Route table is thread safe.
+	 */
+	class Router {
+	public:
+
+		static const int32_t HEADER_SIZE = 8;
+		static const uint8_t DEFAULT_TTL = 16;
+
+		enum Result {
+			// Message is addressed to this node (or to node 0, meaning the
+			// direct peer), payload starts at HEADER_SIZE.
+			DELIVER,
+			FORWARDED,
+			// Malformed header, expired TTL or no route.
+			DROPPED
+		};
+
+		struct Header {
+			uint32_t destination;
+			uint8_t ttl;
+			// Application defined, preserved by forwarding nodes.
+			uint8_t flags;
+		};
+
+		Router();
+
+		void SetLocalNode(uint32_t node);
+		uint32_t GetLocalNode() const;
+
+		// Next hop to node is given socket. Route to node 0 is the default
+		// route, used when no other route matches.
+		void SetRoute(uint32_t node, Context* context, uint64_t handle);
+		void RemoveRoute(uint32_t node);
+		// Removes all routes through socket, intended for its close callback.
+		void RemoveRoutesVia(Context* context, uint64_t handle);
+		bool GetRoute(uint32_t node, Context*& context,
+				uint64_t& handle) const;
+
+		// Must be called on an empty message, payload is written after it.
+		static void WriteHeader(Buffer& message, uint32_t destination,
+				uint8_t ttl = DEFAULT_TTL, uint8_t flags = 0);
+		static bool ReadHeader(const Buffer& message, Header& header);
+
+		// Thread safe, sends message with header to next hop towards its
+		// destination. Message is moved out of the buffer.
+		bool Send(Buffer& message);
+
+		// To be called from onReceiveMessage of the receiving socket's loop.
+		// Forwarded messages are moved out of the buffer. Next hop may be
+		// the receiving socket itself, loops are bounded by TTL.
+		Result OnMessage(Buffer& message, Socket* socket);
+
+		inline uint64_t GetForwardedCount() const {
+			return forwarded.load(std::memory_order_relaxed);
+		}
+		inline uint64_t GetDroppedCount() const {
+			return dropped.load(std::memory_order_relaxed);
+		}
+
+	private:
+
+		struct Hop {
+			Context* context;
+			uint64_t handle;
+		};
+
+		bool InternalFindHop(uint32_t node, Hop& hop) const;
+
+		mutable std::shared_mutex mutex;
+		std::unordered_map<uint32_t, Hop> routes;
+		std::atomic<uint32_t> localNode;
+		std::atomic<uint64_t> forwarded;
+		std::atomic<uint64_t> dropped;
+	};
+}
+
+#endif
+
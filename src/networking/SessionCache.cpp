@@ -0,0 +1,167 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <openssl/ssl.h>
+
+#include "SessionCache.hpp"
+
+namespace networking {
+	namespace impl {
+		static int SslContextCacheIndex() {
+			static int index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL,
+					NULL);
+			return index;
+		}
+
+		static int SslPeerIndex() {
+			static int index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+			return index;
+		}
+
+		static int SslCountedIndex() {
+			static int index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+			return index;
+		}
+
+		static const unsigned char sessionIdContext[] = "DORPC";
+	}
+
+	SessionCache::SessionCache(SSL_CTX* sslContext, size_t capacity) :
+		sslContext(sslContext), capacity(capacity) {
+		clientHandshakes = 0;
+		clientResumed = 0;
+		serverHandshakes = 0;
+		serverResumed = 0;
+		if(sslContext == NULL)
+			return;
+		SSL_CTX_set_ex_data(sslContext, impl::SslContextCacheIndex(), this);
+
+		// Server side: stateless tickets, and a session id context which is
+		// required for resumption when peer certificates are verified.
+		SSL_CTX_clear_options(sslContext, SSL_OP_NO_TICKET);
+		SSL_CTX_set_session_id_context(sslContext, impl::sessionIdContext,
+				sizeof(impl::sessionIdContext)-1);
+		SSL_CTX_sess_set_cache_size(sslContext, capacity);
+
+		// Client side: sessions are handed to InternalOnNewSession.
+		SSL_CTX_set_session_cache_mode(sslContext, SSL_SESS_CACHE_BOTH);
+		SSL_CTX_sess_set_new_cb(sslContext, SessionCache::InternalOnNewSession);
+		SSL_CTX_set_info_callback(sslContext, SessionCache::InternalOnInfo);
+	}
+
+	SessionCache::~SessionCache() {
+		for(auto& it : recent)
+			SSL_SESSION_free(it.second);
+		recent.clear();
+		sessions.clear();
+		if(sslContext) {
+			SSL_CTX_sess_set_new_cb(sslContext, NULL);
+			SSL_CTX_set_info_callback(sslContext, NULL);
+			SSL_CTX_set_ex_data(sslContext, impl::SslContextCacheIndex(), NULL);
+		}
+	}
+
+	void SessionCache::Resume(SSL* ssl, const std::string* peer) {
+		if(ssl == NULL || peer == NULL)
+			return;
+		SSL_set_ex_data(ssl, impl::SslPeerIndex(), (void*)peer);
+		auto it = sessions.find(*peer);
+		if(it == sessions.end())
+			return;
+		auto entry = it->second;
+		SSL_SESSION* session = entry->second;
+		if(SSL_SESSION_is_resumable(session))
+			SSL_set_session(ssl, session);
+		// TLS 1.3 tickets are single use, new ones arrive after handshake.
+		if(SSL_SESSION_is_resumable(session) == 0
+				|| SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION)
+			Erase(entry);
+		else
+			recent.splice(recent.begin(), recent, entry);
+	}
+
+	SessionStats SessionCache::GetStats() const {
+		return SessionStats {
+			.clientHandshakes = clientHandshakes,
+			.clientResumed = clientResumed,
+			.serverHandshakes = serverHandshakes,
+			.serverResumed = serverResumed
+		};
+	}
+
+	void SessionCache::Store(const std::string& peer, SSL_SESSION* session) {
+		auto it = sessions.find(peer);
+		if(it != sessions.end()) {
+			SSL_SESSION_free(it->second->second);
+			it->second->second = session;
+			recent.splice(recent.begin(), recent, it->second);
+			return;
+		}
+		if(sessions.size() >= capacity && recent.empty() == false)
+			Erase(std::prev(recent.end()));
+		recent.emplace_front(peer, session);
+		sessions[peer] = recent.begin();
+	}
+
+	void SessionCache::Erase(std::list<Entry>::iterator entry) {
+		SSL_SESSION_free(entry->second);
+		sessions.erase(entry->first);
+		recent.erase(entry);
+	}
+
+	void SessionCache::CountHandshake(bool isServer, bool resumed) {
+		if(isServer) {
+			serverHandshakes++;
+			if(resumed)
+				serverResumed++;
+		} else {
+			clientHandshakes++;
+			if(resumed)
+				clientResumed++;
+		}
+	}
+
+	int SessionCache::InternalOnNewSession(SSL* ssl, SSL_SESSION* session) {
+		if(SSL_is_server(ssl))
+			return 0;
+		SessionCache* cache = (SessionCache*)SSL_CTX_get_ex_data(
+				SSL_get_SSL_CTX(ssl), impl::SslContextCacheIndex());
+		const std::string* peer = (const std::string*)SSL_get_ex_data(ssl,
+				impl::SslPeerIndex());
+		if(cache == NULL || peer == NULL)
+			return 0;
+		cache->Store(*peer, session);
+		// Returning 1 keeps the reference to the session.
+		return 1;
+	}
+
+	void SessionCache::InternalOnInfo(const SSL* constSsl, int where, int ret) {
+		if((where & SSL_CB_HANDSHAKE_DONE) == 0)
+			return;
+		SSL* ssl = (SSL*)constSsl;
+		// TLS 1.3 servers report handshake done again after sending tickets.
+		if(SSL_get_ex_data(ssl, impl::SslCountedIndex()))
+			return;
+		SSL_set_ex_data(ssl, impl::SslCountedIndex(), (void*)1);
+		SessionCache* cache = (SessionCache*)SSL_CTX_get_ex_data(
+				SSL_get_SSL_CTX(ssl), impl::SslContextCacheIndex());
+		if(cache)
+			cache->CountHandshake(SSL_is_server(ssl), SSL_session_reused(ssl));
+	}
+}
+
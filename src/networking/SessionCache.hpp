@@ -0,0 +1,95 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_SESSION_CACHE_HPP
+#define DORPC_NETWORKING_SESSION_CACHE_HPP
+
+#include <cinttypes>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <atomic>
+
+struct ssl_st;
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+namespace networking {
+	struct SessionStats {
+		uint64_t clientHandshakes;
+		uint64_t clientResumed;
+		uint64_t serverHandshakes;
+		uint64_t serverResumed;
+
+		inline double ClientHitRate() const {
+			return clientHandshakes ? double(clientResumed)/clientHandshakes : 0;
+		}
+		inline double ServerHitRate() const {
+			return serverHandshakes ? double(serverResumed)/serverHandshakes : 0;
+		}
+	};
+
+	/*
+	 * Keeps TLS sessions received by client sockets, keyed by "host:port",
+	 * evicting least recently used peer when full, and enables session tickets on the server side of the same SSL_CTX.
+	 * All modifications happen on the owning loop thread, only the counters
+	 * may be read from other threads.
+	 */
+	class SessionCache {
+	public:
+
+		static const size_t DEFAULT_CAPACITY = 4096;
+
+		SessionCache(struct ssl_ctx_st* sslContext,
+				size_t capacity = DEFAULT_CAPACITY);
+		~SessionCache();
+
+		// Called on client open before the handshake starts. peer has to live
+		// as long as the ssl object.
+		void Resume(struct ssl_st* ssl, const std::string* peer);
+
+		SessionStats GetStats() const;
+
+	private:
+
+		using Entry = std::pair<std::string, struct ssl_session_st*>;
+
+		void Store(const std::string& peer, struct ssl_session_st* session);
+		void Erase(std::list<Entry>::iterator entry);
+		void CountHandshake(bool isServer, bool resumed);
+
+		static int InternalOnNewSession(struct ssl_st* ssl,
+				struct ssl_session_st* session);
+		static void InternalOnInfo(const struct ssl_st* ssl, int where,
+				int ret);
+
+		struct ssl_ctx_st* sslContext;
+		size_t capacity;
+		// Most recently used first.
+		std::list<Entry> recent;
+		std::unordered_map<std::string, std::list<Entry>::iterator> sessions;
+
+		std::atomic<uint64_t> clientHandshakes;
+		std::atomic<uint64_t> clientResumed;
+		std::atomic<uint64_t> serverHandshakes;
+		std::atomic<uint64_t> serverResumed;
+	};
+}
+
+#endif
+
@@ -0,0 +1,61 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SharedFrame.hpp"
+
+#include <mpmc_pool.hpp>
+
+namespace networking {
+	namespace impl {
+		concurrent::mpmc::pool<SharedFrame> sharedFramePool;
+	}
+
+	SharedFrame* SharedFrame::Make(Buffer& message) {
+		Buffer payload = std::move(message);
+		int32_t length = payload.Size();
+		uint8_t b[4];
+		b[0] = (length)&0xFF;
+		b[1] = (length>>8)&0xFF;
+		b[2] = (length>>16)&0xFF;
+		b[3] = (length>>24)&0xFF;
+		SharedFrame* frame = Allocate();
+		frame->bytes.Write(b, 4);
+		if(length)
+			frame->bytes.Write(payload.Data(), length);
+		return frame;
+	}
+
+	SharedFrame* SharedFrame::MakeRaw(const void* data, int32_t bytes) {
+		SharedFrame* frame = Allocate();
+		frame->bytes.Write(data, bytes);
+		return frame;
+	}
+
+	SharedFrame* SharedFrame::Allocate() {
+		SharedFrame* frame = impl::sharedFramePool.acquire();
+		frame->bytes.Clear();
+		frame->references = 1;
+		return frame;
+	}
+
+	void SharedFrame::Free(SharedFrame* frame) {
+		frame->bytes.Destroy();
+		impl::sharedFramePool.release(frame);
+	}
+}
+
@@ -0,0 +1,66 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_SHARED_FRAME_HPP
+#define DORPC_NETWORKING_SHARED_FRAME_HPP
+
+#include <atomic>
+
+#include <mpmc_pool.hpp>
+
+#include "Buffer.hpp"
+
+namespace networking {
+	/*
+	 * Immutable, reference counted, already framed message (4 byte length
+	 * followed by payload). One frame can be queued to any number of sockets,
+	 * each of them writes directly from the shared bytes.
+	 */
+	class SharedFrame : public concurrent::node<SharedFrame> {
+	public:
+
+		// Frames message and takes ownership of its contents. Returned frame
+		// has one reference.
+		static SharedFrame* Make(Buffer& message);
+		// Copies already framed bytes.
+		static SharedFrame* MakeRaw(const void* data, int32_t bytes);
+
+		inline void Acquire() {
+			references.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		inline void Release() {
+			if(references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				Free(this);
+		}
+
+		inline const uint8_t* Data() const { return bytes.Data(); }
+		inline int32_t Size() const { return bytes.Size(); }
+
+	private:
+
+		static SharedFrame* Allocate();
+		static void Free(SharedFrame* frame);
+
+		std::atomic<int32_t> references;
+		Buffer bytes;
+	};
+}
+
+#endif
+
@@ -0,0 +1,251 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "SharedMemoryChannel.hpp"
+
+namespace networking {
+	namespace impl {
+		static const uint32_t sharedMemoryMagic = 0x4350524F;
+	}
+
+	SharedMemoryChannel::SharedMemoryChannel(const char* name, Header* header,
+			size_t mappedSize, bool owner,
+			std::function<void(Buffer&, Endpoint)> onReceiveMessage) :
+		userData(NULL), name(name), header(header), mappedSize(mappedSize),
+		owner(owner), onReceiveMessage(onReceiveMessage) {
+		mask = header->capacity-1;
+		uint8_t* data = (uint8_t*)(header+1);
+		int sendId = owner ? 0 : 1;
+		sendRing = &header->rings[sendId];
+		receiveRing = &header->rings[sendId^1];
+		sendData = data + header->capacity*sendId;
+		receiveData = data + header->capacity*(sendId^1);
+		sendLock.clear();
+	}
+
+	SharedMemoryChannel::~SharedMemoryChannel() {
+		Close();
+		munmap(header, mappedSize);
+		if(owner)
+			shm_unlink(name.c_str());
+	}
+
+	SharedMemoryChannel* SharedMemoryChannel::Create(const char* name,
+			std::function<void(Buffer&, Endpoint)> onReceiveMessage,
+			uint32_t capacity) {
+		uint32_t c = 4096;
+		while(c < capacity)
+			c <<= 1;
+		capacity = c;
+		size_t size = sizeof(Header) + 2*(size_t)capacity;
+		int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if(fd < 0)
+			return NULL;
+		if(ftruncate(fd, size) != 0) {
+			close(fd);
+			shm_unlink(name);
+			return NULL;
+		}
+		void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(ptr == MAP_FAILED) {
+			shm_unlink(name);
+			return NULL;
+		}
+		Header* header = new(ptr) Header();
+		for(Ring& ring : header->rings) {
+			ring.head = 0;
+			ring.tail = 0;
+			ring.waiting = 0;
+			ring.closed = 0;
+		}
+		header->capacity = capacity;
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = impl::sharedMemoryMagic;
+		return new SharedMemoryChannel(name, header, size, true,
+				onReceiveMessage);
+	}
+
+	SharedMemoryChannel* SharedMemoryChannel::Open(const char* name,
+			std::function<void(Buffer&, Endpoint)>
+				onReceiveMessage) {
+		int fd = shm_open(name, O_RDWR, 0600);
+		if(fd < 0)
+			return NULL;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+			close(fd);
+			return NULL;
+		}
+		size_t size = st.st_size;
+		void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(ptr == MAP_FAILED)
+			return NULL;
+		Header* header = (Header*)ptr;
+		if(header->magic != impl::sharedMemoryMagic
+				|| sizeof(Header) + 2*(size_t)header->capacity != size) {
+			munmap(ptr, size);
+			return NULL;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return new SharedMemoryChannel(name, header, size, false,
+				onReceiveMessage);
+	}
+
+	bool SharedMemoryChannel::Send(Buffer& sendBuffer, int timeoutMs) {
+		Buffer message = std::move(sendBuffer);
+		if(message.Size() == 0)
+			return Send(NULL, 0, timeoutMs);
+		return Send(message.Data(), message.Size(), timeoutMs);
+	}
+
+	bool SharedMemoryChannel::Send(const void* data, int32_t bytes,
+			int timeoutMs) {
+		if(bytes < 0 || (uint64_t)bytes+4 > header->capacity || IsClosed())
+			return false;
+		const auto deadline = std::chrono::steady_clock::now()
+			+ std::chrono::milliseconds(timeoutMs);
+		while(sendLock.test_and_set(std::memory_order_acquire))
+			std::this_thread::yield();
+		uint64_t head = sendRing->head.load(std::memory_order_relaxed);
+		while(head + bytes + 4 - sendRing->tail.load(std::memory_order_acquire)
+				> header->capacity) {
+			if(IsClosed() || std::chrono::steady_clock::now() >= deadline) {
+				sendLock.clear(std::memory_order_release);
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		uint8_t size[4];
+		size[0] = (bytes)&0xFF;
+		size[1] = (bytes>>8)&0xFF;
+		size[2] = (bytes>>16)&0xFF;
+		size[3] = (bytes>>24)&0xFF;
+		Write(head, size, 4);
+		if(bytes)
+			Write(head+4, data, bytes);
+		sendRing->head.store(head+4+bytes, std::memory_order_seq_cst);
+		sendLock.clear(std::memory_order_release);
+		if(sendRing->waiting.load(std::memory_order_seq_cst))
+			Wake(&sendRing->waiting);
+		return true;
+	}
+
+	int SharedMemoryChannel::Poll() {
+		int messages = 0;
+		uint64_t tail = receiveRing->tail.load(std::memory_order_relaxed);
+		uint64_t head = receiveRing->head.load(std::memory_order_acquire);
+		while(head - tail >= 4) {
+			uint8_t size[4];
+			Read(tail, size, 4);
+			uint32_t bytes =
+				(uint32_t(size[0]))
+				| (uint32_t(size[1]) << 8)
+				| (uint32_t(size[2]) << 16)
+				| (uint32_t(size[3]) << 24);
+			buffer.Clear();
+			if(bytes) {
+				buffer.Resize(bytes);
+				Read(tail+4, buffer.Data(), bytes);
+			}
+			tail += 4 + bytes;
+			receiveRing->tail.store(tail, std::memory_order_release);
+			if(onReceiveMessage)
+				onReceiveMessage(buffer, this);
+			++messages;
+			head = receiveRing->head.load(std::memory_order_acquire);
+		}
+		return messages;
+	}
+
+	void SharedMemoryChannel::Run() {
+		int idle = 0;
+		while(IsClosed() == false) {
+			if(Poll()) {
+				idle = 0;
+			} else if(++idle >= SPINS_BEFORE_SLEEP) {
+				Wait();
+				idle = 0;
+			} else if(idle >= SPINS_BEFORE_YIELD) {
+				std::this_thread::yield();
+			}
+		}
+		Poll();
+	}
+
+	void SharedMemoryChannel::Close() {
+		sendRing->closed = 1;
+		Wake(&sendRing->waiting);
+		Wake(&receiveRing->waiting);
+	}
+
+	void SharedMemoryChannel::Write(uint64_t position, const void* data,
+			uint32_t bytes) {
+		uint32_t offset = position & mask;
+		uint32_t first = std::min(bytes, header->capacity-offset);
+		memcpy(sendData+offset, data, first);
+		memcpy(sendData, (const uint8_t*)data+first, bytes-first);
+	}
+
+	void SharedMemoryChannel::Read(uint64_t position, void* data,
+			uint32_t bytes) {
+		uint32_t offset = position & mask;
+		uint32_t first = std::min(bytes, header->capacity-offset);
+		memcpy(data, receiveData+offset, first);
+		memcpy((uint8_t*)data+first, receiveData, bytes-first);
+	}
+
+	void SharedMemoryChannel::Wait() {
+		receiveRing->waiting.store(1, std::memory_order_seq_cst);
+		if(receiveRing->head.load(std::memory_order_seq_cst)
+				== receiveRing->tail.load(std::memory_order_relaxed)
+				&& IsClosed() == false) {
+#ifdef __linux__
+			struct timespec timeout = {0, 100*1000*1000};
+			syscall(SYS_futex, (uint32_t*)&receiveRing->waiting, FUTEX_WAIT, 1,
+					&timeout, NULL, 0);
+#else
+			std::this_thread::yield();
+#endif
+		}
+		receiveRing->waiting.store(0, std::memory_order_relaxed);
+	}
+
+	void SharedMemoryChannel::Wake(std::atomic<uint32_t>* address) {
+#ifdef __linux__
+		syscall(SYS_futex, (uint32_t*)address, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+	}
+}
+
@@ -0,0 +1,121 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_SHARED_MEMORY_CHANNEL_HPP
+#define DORPC_NETWORKING_SHARED_MEMORY_CHANNEL_HPP
+
+#include <cinttypes>
+#include <functional>
+#include <string>
+#include <atomic>
+
+#include "Buffer.hpp"
+#include "Endpoint.hpp"
+
+namespace networking {
+	/*
+	 * Message channel between two processes on the same host, built from a
+	 * pair of single producer single consumer byte rings inside one shared
+	 * memory object. Messages use the same 4 byte length framing as Socket.
+	 * The receiving side spins for a while and then sleeps on a futex; the
+	 * sending side does a wake syscall only when the receiver is sleeping.
+	 */
+	class SharedMemoryChannel {
+	public:
+
+		struct Ring {
+			alignas(64) std::atomic<uint64_t> head;
+			alignas(64) std::atomic<uint64_t> tail;
+			alignas(64) std::atomic<uint32_t> waiting;
+			std::atomic<uint32_t> closed;
+		};
+
+		struct Header {
+			uint32_t magic;
+			uint32_t capacity;
+			Ring rings[2];
+		};
+
+		static const uint32_t DEFAULT_CAPACITY = 1<<22;
+		static const int SPINS_BEFORE_YIELD = 64;
+		static const int SPINS_BEFORE_SLEEP = 1<<12;
+		static const int DEFAULT_SEND_TIMEOUT_MS = 1000;
+
+		// Creates new shared memory object, capacity is rounded up to power
+		// of 2 and is per direction.
+		static SharedMemoryChannel* Create(const char* name,
+				std::function<void(Buffer&, Endpoint)>
+					onReceiveMessage,
+				uint32_t capacity = DEFAULT_CAPACITY);
+		// Opens shared memory object made by Create in other process.
+		static SharedMemoryChannel* Open(const char* name,
+				std::function<void(Buffer&, Endpoint)>
+					onReceiveMessage);
+
+		~SharedMemoryChannel();
+
+		// Takes ownership of sendBuffer contents, like Socket::Send. Returns
+		// false when message cannot fit in the ring, channel is closed or
+		// the receiver did not make room within timeoutMs.
+		bool Send(Buffer& sendBuffer,
+				int timeoutMs = DEFAULT_SEND_TIMEOUT_MS);
+		bool Send(const void* data, int32_t bytes,
+				int timeoutMs = DEFAULT_SEND_TIMEOUT_MS);
+
+		// Delivers all available messages on calling thread and returns their
+		// count.
+		int Poll();
+		// Runs Poll in loop on calling thread until Close is called.
+		void Run();
+		void Close();
+
+		inline bool IsClosed() const {
+			return header->rings[0].closed || header->rings[1].closed;
+		}
+
+		void* userData;
+
+	private:
+
+		SharedMemoryChannel(const char* name, Header* header, size_t mappedSize,
+				bool owner,
+				std::function<void(Buffer&, Endpoint)>
+					onReceiveMessage);
+
+		void Write(uint64_t position, const void* data, uint32_t bytes);
+		void Read(uint64_t position, void* data, uint32_t bytes);
+		void Wait();
+		static void Wake(std::atomic<uint32_t>* address);
+
+		std::string name;
+		Header* header;
+		size_t mappedSize;
+		bool owner;
+		uint32_t mask;
+		Ring* sendRing;
+		Ring* receiveRing;
+		uint8_t* sendData;
+		uint8_t* receiveData;
+		std::atomic_flag sendLock;
+		Buffer buffer;
+		std::function<void(Buffer&, Endpoint)> onReceiveMessage;
+	};
+}
+
+#endif
+
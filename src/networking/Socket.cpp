@@ -18,18 +18,27 @@
 
 #include <algorithm>
 
+#include <chrono>
 #include <cinttypes>
 #include <cstring>
+#include <new>
 
 #include <libusockets.h>
 
 #include "Loop.hpp"
 #include "Context.hpp"
 #include "Event.hpp"
+#include "../rpc/FunctionRegistry.hpp"
+#include "../rpc/FunctionTranslation.hpp"
 
 #include "Socket.hpp"
 
 namespace networking {
+	static uint32_t NowMicroseconds() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 	void Socket::Init(struct us_socket_t* socket, int ssl) {
 		this->socket = socket;
 		this->ssl = ssl;
@@ -43,31 +52,89 @@ namespace networking {
 	}
 
 	void Socket::OnOpen(char* ip, int ipLength) {
-		context->sockets->insert(this);
+		new (&buffer) Buffer();
+		readingPaused = 0;
+		accountedBytes = 0;
+		handle = context->sockets->Insert(this);
 		bytes_to_receive = 0;
 		received_bytes_of_size = 0;
+		missedHeartbeats = 0;
+		pingSentAt = 0;
+		smoothedRtt = 0;
+		rttVariance = 0;
+		functionTranslation = NULL;
+		InternalArmHeartbeat();
+		if(context->exchangeFunctionTables) {
+			functionTranslation = new rpc::FunctionTranslation();
+			serialization::Writer writer;
+			rpc::FunctionRegistry::WriteTable(writer);
+			InternalSend(writer.GetBuffer());
+		}
 	}
 
 	void Socket::OnEnd() {
 		buffer.Destroy();
-		context->sockets->erase(this);
+		context->sockets->Erase(handle);
 	}
 
 	void Socket::OnClose(int code, void* reason) {
 		buffer.Destroy();
-		context->sockets->erase(this);
+		InternalClearSendQueue();
+		context->sockets->Erase(handle);
+		delete cold;
+		cold = NULL;
+		delete functionTranslation;
+		functionTranslation = NULL;
+		InternalAccount(-accountedBytes);
 	}
 
 	void Socket::OnTimeout() {
-		// TODO
+		if(context->heartbeatInterval <= 0)
+			return;
+		if(readingPaused) {
+			// Pong cannot be read while paused, outstanding ping is forgotten.
+			pingSentAt = 0;
+			missedHeartbeats = 0;
+		} else if(pingSentAt) {
+			if(++missedHeartbeats >= context->heartbeatMaxMissed) {
+				InternalClose();
+				return;
+			}
+		} else {
+			pingSentAt = std::max(NowMicroseconds(), 1u);
+			InternalSendControl(CONTROL_PING);
+		}
+		InternalArmHeartbeat();
 	}
 
 	void Socket::OnWritable() {
-		// TODO
+		while(InternalHasQueuedFrames()) {
+			auto& front = cold->sendQueue.front();
+			SharedFrame* frame = front.first;
+			int32_t length = frame->Size() - front.second;
+			int written = us_socket_write(ssl, socket,
+					(const char*)frame->Data() + front.second, length, 0);
+			if(written < length) {
+				if(written > 0) {
+					front.second += written;
+					InternalAccount(-written);
+				}
+				if(readingPaused == PAUSED)
+					InternalApplyPause();
+				return;
+			}
+			InternalAccount(-length);
+			frame->Release();
+			cold->sendQueue.pop_front();
+		}
+		InternalReleaseCold();
+		if(readingPaused == PAUSED)
+			InternalApplyPause();
 	}
 
 	void Socket::OnData(uint8_t* data, int length) {
-		while(length) {
+		while(length
+				|| (received_bytes_of_size == 4 && bytes_to_receive == 0)) {
 			if(received_bytes_of_size < 4) {
 				int bytes_to_copy = std::min(4-received_bytes_of_size, length);
 				memcpy(received_size+received_bytes_of_size, data,
@@ -81,46 +148,222 @@ namespace networking {
 						| (int(received_size[1]) << 8)
 						| (int(received_size[2]) << 16)
 						| (int(received_size[3]) << 24);
+					if(bytes_to_receive < 0) {
+						InternalOnControl(bytes_to_receive);
+						bytes_to_receive = 0;
+						received_bytes_of_size = 0;
+						if(us_socket_is_closed(ssl, socket))
+							return;
+						continue;
+					}
+					// Frame which alone exceeds the budget could never be
+					// received without stalling the loop.
+					if(loop->memoryBudget && bytes_to_receive
+							> loop->memoryBudget->GetLimit()) {
+						InternalClose();
+						return;
+					}
+					if(bytes_to_receive)
+						buffer.Reserve(std::min(bytes_to_receive, 1<<20));
 				}
 			} else {
 				int32_t bytes_to_copy = std::min(bytes_to_receive, length);
 				buffer.Write(data, bytes_to_copy);
+				InternalAccount(bytes_to_copy);
 				data += bytes_to_copy;
 				length -= bytes_to_copy;
 				bytes_to_receive -= bytes_to_copy;
 				if(bytes_to_receive == 0) {
-					if(onReceiveMessage)
+					InternalAccount(-buffer.Size());
+					if(functionTranslation
+							&& functionTranslation->IsSynchronized() == false) {
+						serialization::Reader reader(buffer);
+						functionTranslation->ReadRemoteTable(reader);
+					} else if(onReceiveMessage) {
 						(*onReceiveMessage)(buffer, this);
-					buffer.Clear();
+					}
+					buffer.Destroy();
+					received_bytes_of_size = 0;
+					if(us_socket_is_closed(ssl, socket))
+						return;
 				}
 			}
 		}
+		if(readingPaused == PAUSE_REQUESTED && received_bytes_of_size == 0)
+			InternalPauseReading();
 	}
 
 	void Socket::Send(Buffer& sendBuffer) {
-		loop->PushEvent(
-				new Event {
-				.after = NULL,
-				.buffer_or_ip=std::move(sendBuffer),
-				.socket=this,
-				.listenSocket = NULL,
-				.type=Event::SOCKET_SEND
-				});
+		context->Send(handle, sendBuffer);
 	}
 
 	void Socket::InternalSend(Buffer& buffer) {
+		if(InternalHasQueuedFrames()) {
+			SharedFrame* frame = SharedFrame::Make(buffer);
+			InternalSend(frame);
+			frame->Release();
+			return;
+		}
 		int32_t length = buffer.Size();
 		uint8_t b[4];
 		b[0] = (length)&0xFF;
 		b[1] = (length>>8)&0xFF;
 		b[2] = (length>>16)&0xFF;
 		b[3] = (length>>24)&0xFF;
-		us_socket_write(ssl, socket, (char*)b, 4, length);
-		us_socket_write(ssl, socket, (char*)buffer.Data(), length, 0);
+		int written = us_socket_write(ssl, socket, (char*)b, 4, length);
+		if(written < 4) {
+			SharedFrame* frame = SharedFrame::Make(buffer);
+			InternalQueue(frame, std::max(written, 0));
+			frame->Release();
+			return;
+		}
+		written = length ? us_socket_write(ssl, socket, (char*)buffer.Data(),
+				length, 0) : 0;
+		if(written < length) {
+			SharedFrame* rest = SharedFrame::MakeRaw(
+					buffer.Data() + std::max(written, 0),
+					length - std::max(written, 0));
+			InternalSend(rest);
+			rest->Release();
+			// Partial write makes uSockets poll for reading again.
+			if(readingPaused == PAUSED)
+				InternalApplyPause();
+		}
+	}
+
+	void Socket::InternalSend(SharedFrame* frame) {
+		int32_t offset = 0;
+		if(InternalHasQueuedFrames() == false) {
+			int written = us_socket_write(ssl, socket,
+					(const char*)frame->Data(), frame->Size(), 0);
+			if(written >= frame->Size())
+				return;
+			offset = std::max(written, 0);
+		}
+		InternalQueue(frame, offset);
+	}
+
+	void Socket::InternalQueue(SharedFrame* frame, int32_t offset) {
+		InternalAccount(frame->Size() - offset);
+		frame->Acquire();
+		InternalGetCold()->sendQueue.emplace_back(frame, offset);
+		if(readingPaused == PAUSED)
+			InternalApplyPause();
+	}
+
+	void Socket::InternalClearSendQueue() {
+		if(cold == NULL)
+			return;
+		for(auto& it : cold->sendQueue)
+			it.first->Release();
+		cold->sendQueue.clear();
+		InternalReleaseCold();
+	}
+
+	void Socket::InternalReleaseCold() {
+		if(cold && cold->sendQueue.empty() && cold->peerName.empty()) {
+			delete cold;
+			cold = NULL;
+		}
+	}
+
+	void Socket::InternalAccount(int64_t bytes) {
+		if(bytes == 0)
+			return;
+		bool wasCharged = accountedBytes > 0;
+		accountedBytes += bytes;
+		if(loop->memoryBudget) {
+			if(wasCharged == false && accountedBytes > 0)
+				loop->chargedSockets->insert(this);
+			else if(wasCharged && accountedBytes <= 0)
+				loop->chargedSockets->erase(this);
+		}
+		loop->InternalAccount(bytes);
+	}
+
+	void Socket::InternalPauseReading() {
+		if(received_bytes_of_size) {
+			readingPaused = PAUSE_REQUESTED;
+			return;
+		}
+		readingPaused = PAUSED;
+		InternalApplyPause();
+	}
+
+	void Socket::InternalApplyPause() {
+		us_poll_change((struct us_poll_t*)socket, loop->loop,
+				InternalHasQueuedFrames() ? LIBUS_SOCKET_WRITABLE : 0);
+	}
+
+	void Socket::InternalResumeReading() {
+		if(readingPaused == PAUSED)
+			us_poll_change((struct us_poll_t*)socket, loop->loop,
+					LIBUS_SOCKET_READABLE
+					| (InternalHasQueuedFrames() ? LIBUS_SOCKET_WRITABLE : 0));
+		readingPaused = 0;
+	}
+
+	size_t Socket::GetMemoryUsage() const {
+		size_t bytes = sizeof(Socket) + buffer.Capacity();
+		if(cold) {
+			bytes += sizeof(SocketCold) + cold->peerName.capacity();
+			for(auto& it : cold->sendQueue)
+				bytes += sizeof(it) + it.first->Size();
+		}
+		return bytes;
 	}
 
 	void Socket::InternalClose() {
 		us_socket_close(ssl, socket, 0, NULL);
 	}
+
+	void Socket::InternalSendControl(int32_t code) {
+		uint8_t b[4];
+		b[0] = (code)&0xFF;
+		b[1] = (code>>8)&0xFF;
+		b[2] = (code>>16)&0xFF;
+		b[3] = (code>>24)&0xFF;
+		int written = 0;
+		if(InternalHasQueuedFrames() == false)
+			written = std::max(us_socket_write(ssl, socket, (char*)b, 4, 0), 0);
+		if(written < 4) {
+			SharedFrame* frame = SharedFrame::MakeRaw(b+written, 4-written);
+			InternalQueue(frame, 0);
+			frame->Release();
+		}
+	}
+
+	void Socket::InternalOnControl(int32_t code) {
+		switch(code) {
+			case CONTROL_PING:
+				InternalSendControl(CONTROL_PONG);
+				break;
+			case CONTROL_PONG:
+				if(pingSentAt) {
+					// RFC 6298 style smoothing.
+					uint32_t sample = std::max(NowMicroseconds() - pingSentAt,
+							1u);
+					if(smoothedRtt == 0) {
+						smoothedRtt = sample;
+						rttVariance = sample / 2;
+					} else {
+						uint32_t deviation = sample > smoothedRtt
+							? sample - smoothedRtt : smoothedRtt - sample;
+						rttVariance = (rttVariance*3 + deviation) / 4;
+						smoothedRtt = (smoothedRtt*7 + sample) / 8;
+					}
+					pingSentAt = 0;
+					missedHeartbeats = 0;
+				}
+				break;
+			default:
+				InternalClose();
+		}
+	}
+
+	void Socket::InternalArmHeartbeat() {
+		if(context->heartbeatInterval > 0)
+			us_socket_timeout(ssl, socket, context->heartbeatInterval);
+	}
 }
 
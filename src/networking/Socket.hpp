@@ -21,24 +21,73 @@
 
 #include <cinttypes>
 #include <functional>
+#include <string>
+#include <deque>
+#include <utility>
 #include <libusockets.h>
 
 #include "Buffer.hpp"
+#include "SharedFrame.hpp"
+
+namespace rpc {
+	class FunctionTranslation;
+}
 
 namespace networking {
+	// Rarely used per socket state, allocated only when needed.
+	struct SocketCold {
+		// "host:port" of client sockets, used for TLS session resumption.
+		std::string peerName;
+		// Frames not yet accepted by the socket, with offset of first unsent
+		// byte.
+		std::deque<std::pair<SharedFrame*, int32_t>> sendQueue;
+	};
+
 	struct Socket {
 		struct us_socket_t* socket;
 		struct Context* context;
 		struct Loop* loop;
-		int ssl;
 		void* userData;
+		uint64_t handle;
 
+		std::function<void(Buffer&, Socket*)> *onReceiveMessage;
+
+		SocketCold* cold;
+		// Made on open when Context exchanges function tables, the first
+		// received message is the remote table and is not delivered.
+		rpc::FunctionTranslation* functionTranslation;
+
+		// Holds only partially received message, returned to the pool after
+		// every delivered message.
 		Buffer buffer;
-		int32_t received_bytes_of_size;
-		uint8_t received_size[4];
 		int32_t bytes_to_receive;
+		int ssl;
+		uint8_t received_size[4];
+		uint8_t received_bytes_of_size;
 
-		std::function<void(Buffer&, Socket*)> *onReceiveMessage;
+		// 0, PAUSE_REQUESTED or PAUSED. Pause requested in the middle of
+		// a frame takes effect when the frame is complete.
+		uint8_t readingPaused;
+		uint8_t missedHeartbeats;
+		// Bytes of partially received message already buffered and of queued
+		// frames, charged to Loop::memoryBudget.
+		int64_t accountedBytes;
+
+		// Heartbeat state in microseconds, pingSentAt is 0 when no ping is
+		// outstanding and smoothedRtt is 0 until first pong arrives.
+		uint32_t pingSentAt;
+		uint32_t smoothedRtt;
+		uint32_t rttVariance;
+
+		// Negative frame lengths are control frames without payload, handled
+		// before onReceiveMessage.
+		static constexpr int32_t CONTROL_PING = -1;
+		static constexpr int32_t CONTROL_PONG = -2;
+
+		static constexpr uint8_t MAX_MISSED_HEARTBEATS = 255;
+
+		static constexpr uint8_t PAUSE_REQUESTED = 1;
+		static constexpr uint8_t PAUSED = 2;
 
 
 
@@ -46,6 +95,9 @@ namespace networking {
 		void Destroy();
 
 
+		// Enqueued by handle, message is dropped when socket closes before
+		// it is sent. Other threads should keep handles, not Socket pointers,
+		// and use Context::Send.
 		void Send(Buffer& sendBuffer);
 
 
@@ -56,8 +108,48 @@ namespace networking {
 		void OnTimeout();
 		void OnWritable();
 
+		// Bytes of memory pinned by this socket: its own structure, partially
+		// received message, cold state and queued frames.
+		size_t GetMemoryUsage() const;
+
+		// Smoothed round trip time and its mean deviation in microseconds, as
+		// measured by heartbeats. 0 when not yet measured.
+		inline uint32_t GetRtt() const {
+			return smoothedRtt;
+		}
+		inline uint32_t GetRttJitter() const {
+			return rttVariance;
+		}
+
+		// NULL unless Context exchanges function tables, lives until socket
+		// closes.
+		inline const rpc::FunctionTranslation* GetFunctionTranslation() const {
+			return functionTranslation;
+		}
+
 		void InternalSend(Buffer& buffer);
+		void InternalSend(SharedFrame* frame);
+		void InternalQueue(SharedFrame* frame, int32_t offset);
+		void InternalClearSendQueue();
+		void InternalReleaseCold();
+		void InternalAccount(int64_t bytes);
+		void InternalPauseReading();
+		void InternalApplyPause();
+		void InternalResumeReading();
 		void InternalClose();
+		void InternalSendControl(int32_t code);
+		void InternalOnControl(int32_t code);
+		void InternalArmHeartbeat();
+
+		inline SocketCold* InternalGetCold() {
+			if(cold == NULL)
+				cold = new SocketCold();
+			return cold;
+		}
+
+		inline bool InternalHasQueuedFrames() const {
+			return cold && cold->sendQueue.empty() == false;
+		}
 	};
 }
 
@@ -0,0 +1,60 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SocketTable.hpp"
+
+namespace networking {
+	uint64_t SocketTable::Insert(struct Socket* socket) {
+		uint32_t index;
+		if(firstFree != FREE) {
+			index = firstFree;
+			firstFree = slots[index].nextFree;
+		} else {
+			index = slots.size();
+			slots.push_back(Slot{1, FREE, FREE});
+		}
+		Slot& slot = slots[index];
+		slot.dense = dense.size();
+		slot.nextFree = FREE;
+		dense.push_back(socket);
+		denseToSlot.push_back(index);
+		return (uint64_t(slot.generation) << 32) | index;
+	}
+
+	bool SocketTable::Erase(uint64_t handle) {
+		if(Get(handle) == NULL)
+			return false;
+		uint32_t index = Index(handle);
+		Slot& slot = slots[index];
+		uint32_t last = dense.size()-1;
+		if(slot.dense != last) {
+			dense[slot.dense] = dense[last];
+			denseToSlot[slot.dense] = denseToSlot[last];
+			slots[denseToSlot[slot.dense]].dense = slot.dense;
+		}
+		dense.pop_back();
+		denseToSlot.pop_back();
+		slot.dense = FREE;
+		if(++slot.generation == 0)
+			slot.generation = 1;
+		slot.nextFree = firstFree;
+		firstFree = index;
+		return true;
+	}
+}
+
@@ -0,0 +1,85 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_SOCKET_TABLE_HPP
+#define DORPC_NETWORKING_SOCKET_TABLE_HPP
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+namespace networking {
+	/*
+	 * Dense slot map of live sockets of one Context. Handles contain slot
+	 * index in lower 32 bits and slot generation in upper 32 bits, so handle
+	 * of closed socket is rejected even after its slot is reused. Handle 0 is
+	 * never valid. Must be used only from the loop thread.
+	 */
+	class SocketTable {
+	public:
+
+		inline static uint32_t Index(uint64_t handle) {
+			return handle & 0xFFFFFFFF;
+		}
+
+		inline static uint32_t Generation(uint64_t handle) {
+			return handle >> 32;
+		}
+
+		uint64_t Insert(struct Socket* socket);
+		bool Erase(uint64_t handle);
+
+		inline struct Socket* Get(uint64_t handle) const {
+			uint32_t index = Index(handle);
+			if(index >= slots.size())
+				return NULL;
+			const Slot& slot = slots[index];
+			if(slot.generation != Generation(handle) || slot.dense == FREE)
+				return NULL;
+			return dense[slot.dense];
+		}
+
+		inline size_t size() const { return dense.size(); }
+		inline bool empty() const { return dense.empty(); }
+		inline std::vector<struct Socket*>::const_iterator begin() const {
+			return dense.begin();
+		}
+		inline std::vector<struct Socket*>::const_iterator end() const {
+			return dense.end();
+		}
+
+	private:
+
+		static const uint32_t FREE = 0xFFFFFFFF;
+
+		struct Slot {
+			uint32_t generation;
+			// FREE when slot is unused.
+			uint32_t dense;
+			uint32_t nextFree;
+		};
+
+		std::vector<Slot> slots;
+		std::vector<struct Socket*> dense;
+		std::vector<uint32_t> denseToSlot;
+		uint32_t firstFree = FREE;
+	};
+}
+
+#endif
+
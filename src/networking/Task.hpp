@@ -0,0 +1,76 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_NETWORKING_TASK_HPP
+#define DORPC_NETWORKING_TASK_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <concurrent.hpp>
+
+namespace networking {
+	/*
+	 * Pooled node holding any callable. Callables up to INLINE_SIZE bytes are
+	 * stored inside the node, bigger ones are moved to the heap.
+	 */
+	class Task : public concurrent::node<Task> {
+	public:
+
+		static const size_t INLINE_SIZE = 48;
+
+		template<typename F>
+		static Task* Make(F&& callable);
+
+		inline void Run() {
+			invoke(storage);
+		}
+
+		static void Free(Task* task);
+
+	private:
+
+		static Task* Allocate();
+
+		void (*invoke)(void*);
+		void (*destroy)(void*);
+		alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+	};
+
+	template<typename F>
+	inline Task* Task::Make(F&& callable) {
+		using T = std::decay_t<F>;
+		Task* task = Allocate();
+		if constexpr(sizeof(T) <= INLINE_SIZE
+				&& alignof(T) <= alignof(std::max_align_t)) {
+			new (task->storage) T(std::forward<F>(callable));
+			task->invoke = [](void* ptr) { (*(T*)ptr)(); };
+			task->destroy = [](void* ptr) { ((T*)ptr)->~T(); };
+		} else {
+			*(T**)task->storage = new T(std::forward<F>(callable));
+			task->invoke = [](void* ptr) { (**(T**)ptr)(); };
+			task->destroy = [](void* ptr) { delete *(T**)ptr; };
+		}
+		return task;
+	}
+}
+
+#endif
+
@@ -0,0 +1,62 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <mutex>
+
+#include "LocationCache.hpp"
+
+namespace rmi {
+	
+	LocationCache::LocationCache(size_t capacity) : capacity(capacity) {
+	}
+	
+	NodeId LocationCache::Find(ObjectId id) const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto it = locations.find(id);
+		if(it == locations.end())
+			return 0;
+		return it->second;
+	}
+	
+	void LocationCache::Update(ObjectId id, NodeId node) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		// Stale entries only cost one extra hop, so the whole cache is simply
+		// dropped when full.
+		if(locations.size() >= capacity)
+			locations.clear();
+		locations[id] = node;
+	}
+	
+	void LocationCache::Invalidate(ObjectId id, NodeId node) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		auto it = locations.find(id);
+		if(it != locations.end() && it->second == node)
+			locations.erase(it);
+	}
+	
+	void LocationCache::Clear() {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		locations.clear();
+	}
+	
+	size_t LocationCache::Size() const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return locations.size();
+	}
+}
+
@@ -0,0 +1,56 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_LOCATION_CACHE_HPP
+#define DORPC_RMI_LOCATION_CACHE_HPP
+
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstddef>
+
+#include "Object.hpp"
+
+namespace rmi {
+	/*
+	 * Caller side cache of current owners of migrated objects, learned from
+	 * location hints sent by forwarding nodes. Entries are dropped lazily,
+	 * when a call sent to cached node misses the object. Thread safe.
+	 */
+	class LocationCache {
+	public:
+		
+		LocationCache(size_t capacity = 1<<20);
+		
+		// Returns 0 if location is not cached.
+		NodeId Find(ObjectId id) const;
+		void Update(ObjectId id, NodeId node);
+		// Drops entry only if it still points to node which missed.
+		void Invalidate(ObjectId id, NodeId node);
+		void Clear();
+		size_t Size() const;
+		
+	private:
+		
+		mutable std::shared_mutex mutex;
+		std::unordered_map<ObjectId, NodeId> locations;
+		size_t capacity;
+	};
+}
+
+#endif
+
@@ -0,0 +1,180 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_METHOD_HPP
+#define DORPC_RMI_METHOD_HPP
+
+#include <atomic>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include "../rpc/FunctionBase.hpp"
+#include "../rpc/FunctionRegistry.hpp"
+#include "../rpc/Function.hpp"
+#include "Object.hpp"
+#include "ObjectRegistry.hpp"
+#include "ObjectGuard.hpp"
+
+namespace rpc {
+	template<typename Class, typename Ret, typename... Args>
+	struct FunctionTraits<Ret(Class::*)(Args...)>
+		: FunctionTraits<Ret(*)(Args...)> {
+		using object = Class;
+	};
+	
+	template<typename Class, typename Ret, typename... Args>
+	struct FunctionTraits<Ret(Class::*)(Args...) const>
+		: FunctionTraits<Ret(*)(Args...)> {
+		using object = Class;
+	};
+}
+
+namespace rmi {
+	/*
+	 * Remotely invokable member function. Methods share ids, names and
+	 * fingerprints with rpc functions, so they are dispatched, batched and
+	 * translated by rpc::FunctionRegistry. On the wire method id is followed
+	 * by target ObjectId and then by arguments.
+	 */
+	template<typename Type, Type ptr>
+	class Method : public rpc::FunctionBase {
+	public:
+		
+		using Traits = rpc::FunctionTraits<Type>;
+		using Class = typename Traits::object;
+		
+		static_assert(std::is_base_of_v<Object, Class>,
+				"Methods can be registered only for classes derived from "
+				"rmi::Object");
+		
+		// Member pointers can not be converted to void*, unique address of
+		// static member identifies the method instead.
+		inline virtual void* GetPtr() override {
+			return StaticGetPtr();
+		}
+		
+		inline static void* StaticGetPtr() {
+			return (void*)&instance;
+		}
+		
+		virtual bool HasTargetObject() const override {
+			return true;
+		}
+		
+		virtual ~Method() override {
+			Method* self = this;
+			instance.compare_exchange_strong(self, NULL);
+			rpc::FunctionRegistry::Remove(this);
+		}
+		
+		inline static void Register(const char* name = "") {
+			Method<Type, ptr>* method = new Method<Type, ptr>();
+			method->SetName(name);
+			method->SetFingerprint(rpc::HashString(name, Traits::signature));
+			rpc::FunctionRegistry::Add(method);
+			instance.store(method, std::memory_order_release);
+		}
+		
+		inline static rpc::FunctionBase* Instance() {
+			return instance.load(std::memory_order_acquire);
+		}
+		
+		template<typename... Args>
+		inline static bool PrepareCall(serialization::Writer& writer,
+				ObjectId object, Args&&... args) {
+			return WriteCall(writer, 0, object, std::forward<Args>(args)...);
+		}
+		
+		template<typename... Args>
+		inline static bool PrepareOneWayCall(serialization::Writer& writer,
+				ObjectId object, Args&&... args) {
+			return WriteCall(writer, ONE_WAY_FLAG, object,
+					std::forward<Args>(args)...);
+		}
+		
+		virtual bool Execute(serialization::Reader& reader) override {
+			ObjectGuard guard;
+			Class* object = ReadObject(reader);
+			if(object == NULL)
+				return false;
+			typename Traits::decayed_tuple args;
+			reader >> args;
+			Invoke(object, args, std::make_index_sequence<
+					std::tuple_size_v<decltype(args)>>{});
+			return true;
+		}
+		
+		virtual bool ExecuteWithReturn(serialization::Reader& reader,
+				serialization::Writer& writerRet) override {
+			ObjectGuard guard;
+			Class* object = ReadObject(reader);
+			if(object == NULL)
+				return false;
+			typename Traits::decayed_tuple args;
+			reader >> args;
+			if constexpr(std::is_void_v<typename Traits::ret>)
+				Invoke(object, args, std::make_index_sequence<
+						std::tuple_size_v<decltype(args)>>{});
+			else
+				writerRet << Invoke(object, args, std::make_index_sequence<
+						std::tuple_size_v<decltype(args)>>{});
+			return true;
+		}
+		
+		template<size_t... I>
+		inline static typename Traits::ret Invoke(Class* object,
+				typename Traits::decayed_tuple& args,
+				std::index_sequence<I...>) {
+			using tuple = typename Traits::tuple;
+			return (object->*ptr)(static_cast<rpc::ForwardedArg<
+					std::tuple_element_t<I, tuple>>>(std::get<I>(args))...);
+		}
+		
+	protected:
+		
+		Method() = default;
+		
+		inline static Class* ReadObject(serialization::Reader& reader) {
+			ObjectId id = 0;
+			reader >> id;
+			return dynamic_cast<Class*>(ObjectRegistry::Get(id));
+		}
+		
+		template<typename... Args>
+		inline static bool WriteCall(serialization::Writer& writer,
+				uint32_t flags, ObjectId object, Args&&... args) {
+			rpc::FunctionBase* method = Instance();
+			if(method == NULL)
+				return false;
+			writer << (method->GetId() | flags) << object;
+			Traits::WriteArgs(writer, std::forward<Args>(args)...);
+			return true;
+		}
+		
+		inline static std::atomic<Method*> instance = NULL;
+	};
+}
+
+#define METHOD(__C, __M) \
+	rmi::Method<decltype(&__C::__M), &__C::__M>::Instance()
+#define REGISTER_METHOD(__C, __M) \
+	rmi::Method<decltype(&__C::__M), &__C::__M>::Register(#__C "::" #__M)
+
+#endif
+
@@ -0,0 +1,65 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_OBJECT_HPP
+#define DORPC_RMI_OBJECT_HPP
+
+#include <atomic>
+#include <cinttypes>
+
+#include "../serialization/serializator.hpp"
+
+namespace rmi {
+	
+	// Object ids are unique in the whole cluster, 0 is never valid.
+	using ObjectId = uint64_t;
+	// 0 means unknown node.
+	using NodeId = uint32_t;
+	
+	class Mailbox;
+	
+	// Base class of remotely invokable objects.
+	class Object {
+	public:
+		
+		virtual ~Object();
+		
+		inline ObjectId GetObjectId() const { return objectId; }
+		
+		// State transferred when object migrates to other node. Class must
+		// also be registered with REGISTER_OBJECT_TYPE.
+		virtual void Serialize(serialization::Writer& writer) const {}
+		virtual void Deserialize(serialization::Reader& reader) {}
+		
+	protected:
+		
+		Object() : objectId(0), mailbox(NULL) {}
+		
+	private:
+		
+		friend class ObjectRegistry;
+		friend class Scheduler;
+		
+		ObjectId objectId;
+		// Pending calls, created by Scheduler on first call of this object.
+		std::atomic<Mailbox*> mailbox;
+	};
+}
+
+#endif
+
@@ -0,0 +1,154 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "ObjectGuard.hpp"
+
+namespace rmi {
+	
+	namespace impl {
+		struct GuardRecord {
+			// Epoch observed by outermost guard, 0 when thread has no guard.
+			std::atomic<uint64_t> epoch = 0;
+			uint32_t depth = 0;
+		};
+		
+		struct Retired {
+			// Epoch of retirement.
+			uint64_t epoch;
+			void* pointer;
+			void (*deleter)(void*);
+		};
+		
+		struct GuardState {
+			~GuardState() {
+				for(Retired& it : retired)
+					it.deleter(it.pointer);
+			}
+			
+			std::atomic<uint64_t> epoch = 1;
+			std::atomic<size_t> retiredCount = 0;
+			std::mutex mutex;
+			std::vector<GuardRecord*> records;
+			std::vector<Retired> retired;
+			
+			// Frees memory retired before every active guard was created.
+			void Reclaim() {
+				std::vector<Retired> reclaimed;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					uint64_t oldest = UINT64_MAX;
+					for(GuardRecord* record : records) {
+						uint64_t epoch = record->epoch.load();
+						if(epoch)
+							oldest = std::min(oldest, epoch);
+					}
+					auto end = std::partition(retired.begin(), retired.end(),
+							[oldest](const Retired& it) {
+								return it.epoch >= oldest;
+							});
+					reclaimed.assign(end, retired.end());
+					retired.erase(end, retired.end());
+					retiredCount = retired.size();
+				}
+				// Destructors of objects may use guards themselves.
+				for(Retired& it : reclaimed)
+					it.deleter(it.pointer);
+			}
+		};
+		
+		static void DeleteObject(void* object) {
+			delete (Object*)object;
+		}
+		
+		static GuardState& GetGuardState() {
+			static GuardState state;
+			return state;
+		}
+		
+		struct ThreadGuardRecord {
+			ThreadGuardRecord() {
+				GuardState& state = GetGuardState();
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.records.push_back(&record);
+			}
+			~ThreadGuardRecord() {
+				GuardState& state = GetGuardState();
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.records.erase(std::find(state.records.begin(),
+							state.records.end(), &record));
+			}
+			
+			GuardRecord record;
+		};
+		
+		static GuardRecord& GetThreadRecord() {
+			thread_local ThreadGuardRecord record;
+			return record.record;
+		}
+	}
+	
+	ObjectGuard::ObjectGuard() {
+		impl::GuardRecord& record = impl::GetThreadRecord();
+		if(record.depth++ == 0)
+			// Sequentially consistent store orders it before following reads
+			// of ObjectTable, paired with the fence in Retire.
+			record.epoch.store(impl::GetGuardState().epoch.load());
+	}
+	
+	ObjectGuard::~ObjectGuard() {
+		impl::GuardRecord& record = impl::GetThreadRecord();
+		if(--record.depth)
+			return;
+		record.epoch.store(0, std::memory_order_release);
+	}
+	
+	void ObjectGuard::Retire(Object* object) {
+		Retire(object, impl::DeleteObject);
+	}
+	
+	void ObjectGuard::Retire(void* pointer, void (*deleter)(void*)) {
+		if(pointer == NULL)
+			return;
+		impl::GuardState& state = impl::GetGuardState();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			// Guard which could still see the pointer has observed this or
+			// older epoch.
+			state.retired.push_back({state.epoch.fetch_add(1), pointer,
+					deleter});
+			state.retiredCount = state.retired.size();
+		}
+		state.Reclaim();
+	}
+	
+	void ObjectGuard::Reclaim() {
+		impl::GuardState& state = impl::GetGuardState();
+		if(state.retiredCount.load(std::memory_order_relaxed))
+			state.Reclaim();
+	}
+	
+	size_t ObjectGuard::GetRetiredCount() {
+		return impl::GetGuardState().retiredCount.load();
+	}
+}
+
@@ -0,0 +1,63 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_OBJECT_GUARD_HPP
+#define DORPC_RMI_OBJECT_GUARD_HPP
+
+#include <atomic>
+#include <cinttypes>
+
+#include "Object.hpp"
+
+namespace rmi {
+	/*
+	 * Epoch based protection of objects obtained from ObjectRegistry. Object
+	 * pointer returned by ObjectRegistry::Get stays valid as long as guard
+	 * created before the Get exists on the same thread. Objects removed from
+	 * the registry are passed to Retire instead of being deleted and are
+	 * freed only after every guard which could have seen them is destroyed.
+	 * Guards may be nested, they do not block each other nor Retire and never
+	 * take locks.
+	 */
+	class ObjectGuard {
+	public:
+		
+		ObjectGuard();
+		~ObjectGuard();
+		
+		ObjectGuard(const ObjectGuard&) = delete;
+		ObjectGuard& operator=(const ObjectGuard&) = delete;
+		
+		// Deletes object once no guard can reference it, object must be
+		// already removed from ObjectRegistry.
+		static void Retire(Object* object);
+		// Same for other memory read under guards, deleter(pointer) is called
+		// once no guard can reference it.
+		static void Retire(void* pointer, void (*deleter)(void*));
+		// Frees retired memory no active guard can reference. Called by
+		// Retire, guards themselves only publish their exit, so memory
+		// retired while a guard was active waits for the next Retire or
+		// Reclaim call.
+		static void Reclaim();
+		// Retired objects and memory not yet freed.
+		static size_t GetRetiredCount();
+	};
+}
+
+#endif
+
@@ -0,0 +1,478 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include "../rpc/FunctionRegistry.hpp"
+#include "../rpc/Function.hpp"
+#include "../rpc/FunctionTranslation.hpp"
+
+#include "Snapshot.hpp"
+#include "ObjectGuard.hpp"
+
+#include "ObjectRegistry.hpp"
+
+namespace rmi {
+	
+	namespace impl {
+		static void ImportObject(ObjectId id, std::string type,
+				std::string_view state) {
+			ObjectRegistry::Import(id, type, state);
+		}
+		
+		static void SetLocation(ObjectId id, NodeId node) {
+			ObjectRegistry::UpdateLocation(id, node);
+		}
+		
+		static void LocationHint(ObjectId id, NodeId node) {
+			ObjectRegistry::GetLocationCache().Update(id, node);
+		}
+		
+		static void LocationMiss(ObjectId id, NodeId node) {
+			ObjectRegistry::GetLocationCache().Invalidate(id, node);
+		}
+		
+		thread_local NodeId senderNode = 0;
+		
+		// Only node connected through the link which delivered the request
+		// may ask for a lease for itself.
+		static void RequestLease(NodeId node) {
+			if(node != senderNode)
+				return;
+			ObjectRegistry::GrantLease(node);
+		}
+		
+		// Announcements are accepted only from the leader.
+		static void LeaseGranted(NodeId node, ObjectId begin, ObjectId end) {
+			if(senderNode == 0 || senderNode != ObjectRegistry::GetLeader())
+				return;
+			ObjectRegistry::OnLeaseGranted(node, begin, end);
+		}
+	}
+	
+	ObjectRegistry::ObjectRegistry() : localNode(0), freeIds(0),
+			leasePending(false), leaderNode(0), leaseSpace(0, 0),
+			snapshot(NULL) {
+		rpc::RegisterFunction<decltype(&impl::ImportObject),
+			impl::ImportObject>("rmi::ImportObject");
+		rpc::RegisterFunction<decltype(&impl::SetLocation),
+			impl::SetLocation>("rmi::SetLocation");
+		rpc::RegisterFunction<decltype(&impl::LocationHint),
+			impl::LocationHint>("rmi::LocationHint");
+		rpc::RegisterFunction<decltype(&impl::LocationMiss),
+			impl::LocationMiss>("rmi::LocationMiss");
+		rpc::RegisterFunction<decltype(&impl::RequestLease),
+			impl::RequestLease>("rmi::RequestLease");
+		rpc::RegisterFunction<decltype(&impl::LeaseGranted),
+			impl::LeaseGranted>("rmi::LeaseGranted");
+	}
+	
+	ObjectRegistry& ObjectRegistry::Singleton() {
+		static ObjectRegistry singleton;
+		return singleton;
+	}
+	
+	void ObjectRegistry::SetLocalNode(NodeId node) {
+		Singleton().localNode = node;
+	}
+	
+	NodeId ObjectRegistry::GetLocalNode() {
+		return Singleton().localNode;
+	}
+	
+	void ObjectRegistry::AddLocalRange(ObjectId begin, ObjectId end) {
+		if(begin == 0)
+			++begin;
+		if(begin >= end)
+			return;
+		ObjectRegistry& registry = Singleton();
+		registry.ranges.Add(begin, end, registry.localNode);
+		std::lock_guard<std::mutex> lock(registry.allocationMutex);
+		registry.freeRanges.emplace_back(begin, end);
+		registry.freeIds += end - begin;
+	}
+	
+	void ObjectRegistry::AddRemoteRange(ObjectId begin, ObjectId end,
+			NodeId node) {
+		Singleton().ranges.Add(begin, end, node);
+	}
+	
+	void ObjectRegistry::SetLeader(NodeId leader) {
+		Singleton().leaderNode = leader;
+	}
+	
+	NodeId ObjectRegistry::GetLeader() {
+		return Singleton().leaderNode;
+	}
+	
+	void ObjectRegistry::SetSenderNode(NodeId node) {
+		impl::senderNode = node;
+	}
+	
+	NodeId ObjectRegistry::GetSenderNode() {
+		return impl::senderNode;
+	}
+	
+	void ObjectRegistry::SetLeaseSpace(ObjectId begin, ObjectId end) {
+		ObjectRegistry& registry = Singleton();
+		if(begin == 0)
+			++begin;
+		std::lock_guard<std::mutex> lock(registry.allocationMutex);
+		registry.leaseSpace = {begin, std::max(begin, end)};
+	}
+	
+	void ObjectRegistry::SetLeaseTransport(
+			std::function<void(NodeId, serialization::Writer&)> send) {
+		ObjectRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.allocationMutex);
+		registry.leaseTransport = send;
+	}
+	
+	void ObjectRegistry::RequestLease() {
+		ObjectRegistry& registry = Singleton();
+		const NodeId leader = registry.leaderNode;
+		std::function<void(NodeId, serialization::Writer&)> send;
+		{
+			std::lock_guard<std::mutex> lock(registry.allocationMutex);
+			send = registry.leaseTransport;
+			registry.leasePending = leader != 0;
+			registry.leaseRequestedAt = std::chrono::steady_clock::now();
+		}
+		if(leader == 0)
+			return;
+		bool requested = false;
+		if(leader == registry.localNode) {
+			requested = GrantLease(leader);
+		} else if(send) {
+			serialization::Writer call;
+			rpc::Function<decltype(&impl::RequestLease), impl::RequestLease>
+				::PrepareOneWayCall(call, registry.localNode.load());
+			send(leader, call);
+			requested = true;
+		}
+		if(requested == false) {
+			std::lock_guard<std::mutex> lock(registry.allocationMutex);
+			registry.leasePending = false;
+		}
+	}
+	
+	bool ObjectRegistry::GrantLease(NodeId node) {
+		ObjectRegistry& registry = Singleton();
+		if(node == 0 || registry.leaderNode != registry.localNode)
+			return false;
+		ObjectId begin, end;
+		std::function<void(NodeId, serialization::Writer&)> send;
+		{
+			std::lock_guard<std::mutex> lock(registry.allocationMutex);
+			auto& space = registry.leaseSpace;
+			if(space.first >= space.second)
+				return false;
+			begin = space.first;
+			end = begin + std::min(LEASE_SIZE, space.second - begin);
+			space.first = end;
+			send = registry.leaseTransport;
+		}
+		OnLeaseGranted(node, begin, end);
+		if(send) {
+			serialization::Writer call;
+			rpc::Function<decltype(&impl::LeaseGranted), impl::LeaseGranted>
+				::PrepareOneWayCall(call, node, begin, end);
+			send(0, call);
+		}
+		return true;
+	}
+	
+	void ObjectRegistry::OnLeaseGranted(NodeId node, ObjectId begin,
+			ObjectId end) {
+		ObjectRegistry& registry = Singleton();
+		if(node != registry.localNode) {
+			AddRemoteRange(begin, end, node);
+			return;
+		}
+		AddLocalRange(begin, end);
+		std::lock_guard<std::mutex> lock(registry.allocationMutex);
+		registry.leasePending = false;
+	}
+	
+	ObjectId ObjectRegistry::GetFreeIdCount() {
+		ObjectRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.allocationMutex);
+		return registry.freeIds;
+	}
+	
+	bool ObjectRegistry::InternalTakeBlock(ObjectId& begin, ObjectId& end) {
+		bool taken = false, request = false;
+		{
+			std::lock_guard<std::mutex> lock(allocationMutex);
+			while(freeRanges.size()) {
+				auto& range = freeRanges.front();
+				if(range.first < range.second) {
+					begin = range.first;
+					end = begin + std::min(THREAD_BLOCK,
+							range.second - range.first);
+					range.first = end;
+					freeIds -= end - begin;
+					taken = true;
+					break;
+				}
+				freeRanges.pop_front();
+			}
+			// Next range is requested while half of current one is left.
+			// Request or its grant may be lost, so it is repeated after
+			// timeout.
+			if(freeIds < LEASE_SIZE/2 && leaderNode != 0
+					&& (leasePending == false
+						|| std::chrono::steady_clock::now() - leaseRequestedAt
+						>= std::chrono::milliseconds(LEASE_TIMEOUT_MS))) {
+				leasePending = true;
+				request = true;
+			}
+		}
+		if(request)
+			RequestLease();
+		return taken;
+	}
+	
+	ObjectId ObjectRegistry::Add(Object* object) {
+		thread_local ObjectId next = 0, end = 0;
+		if(object == NULL)
+			return 0;
+		ObjectRegistry& registry = Singleton();
+		Snapshot* snapshot = registry.snapshot.load(std::memory_order_acquire);
+		for(;;) {
+			if(next == end) {
+				if(registry.InternalTakeBlock(next, end) == false)
+					return 0;
+			}
+			const ObjectId id = next++;
+			// Ids of objects not yet rehydrated are still taken.
+			if(snapshot && snapshot->Contains(id))
+				continue;
+			// Id may be already taken by imported object.
+			if(Insert(id, object) == false)
+				continue;
+			return id;
+		}
+	}
+	
+	bool ObjectRegistry::Insert(ObjectId id, Object* object) {
+		if(Singleton().table.Insert(id, object) == false)
+			return false;
+		object->objectId = id;
+		return true;
+	}
+	
+	Object* ObjectRegistry::Remove(ObjectId id) {
+		ObjectRegistry& registry = Singleton();
+		Object* object = registry.table.Remove(id);
+		Snapshot* snapshot = registry.snapshot.load(std::memory_order_acquire);
+		if(snapshot)
+			snapshot->MarkRemoved(id);
+		return object;
+	}
+	
+	bool ObjectRegistry::Destroy(ObjectId id) {
+		Object* object = Remove(id);
+		if(object == NULL)
+			return false;
+		ObjectGuard::Retire(object);
+		return true;
+	}
+	
+	void ObjectRegistry::SetSnapshot(Snapshot* snapshot) {
+		Singleton().snapshot = snapshot;
+	}
+	
+	Object* ObjectRegistry::InternalLoad(ObjectId id) {
+		Snapshot* snapshot = Singleton().snapshot.load(
+				std::memory_order_acquire);
+		if(snapshot)
+			return snapshot->Rehydrate(id);
+		return Singleton().table.Get(id);
+	}
+	
+	NodeId ObjectRegistry::GetOwner(ObjectId id) {
+		ObjectRegistry& registry = Singleton();
+		ObjectGuard guard;
+		if(registry.table.Get(id))
+			return registry.localNode;
+		{
+			std::lock_guard<std::mutex> lock(registry.locationsMutex);
+			auto it = registry.delegated.find(id);
+			if(it != registry.delegated.end())
+				return it->second;
+		}
+		return registry.ranges.Find(id);
+	}
+	
+	NodeId ObjectRegistry::Route(ObjectId id) {
+		NodeId node = Singleton().locationCache.Find(id);
+		if(node)
+			return node;
+		return GetOwner(id);
+	}
+	
+	bool ObjectRegistry::GetTypeName(const Object* object, std::string& name) {
+		ObjectRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.typesMutex);
+		auto it = registry.typeNames.find(typeid(*object));
+		if(it == registry.typeNames.end())
+			return false;
+		name = it->second;
+		return true;
+	}
+	
+	void ObjectRegistry::RegisterType(const std::type_info& type,
+			const std::string& name, Factory factory) {
+		ObjectRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.typesMutex);
+		registry.typeNames[type] = name;
+		registry.factories[name] = factory;
+	}
+	
+	bool ObjectRegistry::Migrate(ObjectId id, NodeId target,
+			serialization::Writer& importCall,
+			serialization::Writer& originCall, NodeId& originNode) {
+		ObjectRegistry& registry = Singleton();
+		ObjectGuard guard;
+		originNode = 0;
+		if(target == 0 || target == registry.localNode)
+			return false;
+		Object* object = Get(id);
+		std::string type;
+		if(object == NULL || GetTypeName(object, type) == false)
+			return false;
+		object = Remove(id);
+		if(object == NULL)
+			return false;
+		
+		serialization::Writer state;
+		object->Serialize(state);
+		ObjectGuard::Retire(object);
+		SetLocation(id, target);
+		
+		networking::Buffer& buffer = state.GetBuffer();
+		const std::string_view stateView = buffer.Size()
+			? std::string_view((const char*)buffer.Data(), buffer.Size())
+			: std::string_view();
+		rpc::Function<decltype(&impl::ImportObject), impl::ImportObject>
+			::PrepareOneWayCall(importCall, id, type, stateView);
+		
+		const NodeId origin = registry.ranges.Find(id);
+		if(origin && origin != registry.localNode && origin != target) {
+			rpc::Function<decltype(&impl::SetLocation), impl::SetLocation>
+				::PrepareOneWayCall(originCall, id, target);
+			originNode = origin;
+		}
+		return true;
+	}
+	
+	bool ObjectRegistry::Import(ObjectId id, const std::string& type,
+			std::string_view state) {
+		ObjectRegistry& registry = Singleton();
+		// Ids outside of known ranges would only grow ObjectTable.
+		if(registry.ranges.Find(id) == 0)
+			return false;
+		Factory factory = NULL;
+		{
+			std::lock_guard<std::mutex> lock(registry.typesMutex);
+			auto it = registry.factories.find(type);
+			if(it == registry.factories.end())
+				return false;
+			factory = it->second;
+		}
+		Object* object = factory();
+		networking::Buffer buffer;
+		buffer.Write(state.data(), state.size());
+		serialization::Reader reader(buffer);
+		object->Deserialize(reader);
+		if(Insert(id, object) == false) {
+			delete object;
+			return false;
+		}
+		SetLocation(id, registry.localNode);
+		return true;
+	}
+	
+	void ObjectRegistry::SetLocation(ObjectId id, NodeId node) {
+		ObjectRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.locationsMutex);
+		if(node == registry.localNode)
+			registry.delegated.erase(id);
+		else
+			registry.delegated[id] = node;
+	}
+	
+	bool ObjectRegistry::UpdateLocation(ObjectId id, NodeId node) {
+		ObjectRegistry& registry = Singleton();
+		ObjectGuard guard;
+		if(node == 0 || node == registry.localNode || registry.table.Get(id))
+			return false;
+		std::lock_guard<std::mutex> lock(registry.locationsMutex);
+		auto it = registry.delegated.find(id);
+		if(it != registry.delegated.end())
+			it->second = node;
+		else if(registry.ranges.Find(id) == registry.localNode)
+			registry.delegated[id] = node;
+		else
+			return false;
+		return true;
+	}
+	
+	ObjectId ObjectRegistry::PeekTargetObject(networking::Buffer& call,
+			const rpc::FunctionTranslation* translation) {
+		if(call.Size() < 12)
+			return 0;
+		serialization::Reader reader(call);
+		uint32_t functionId = 0;
+		ObjectId id = 0;
+		reader >> functionId;
+		functionId &= ~rpc::FunctionBase::ONE_WAY_FLAG;
+		if(translation)
+			functionId = translation->ToLocal(functionId);
+		rpc::FunctionBase* function = rpc::FunctionRegistry::GetById(
+				functionId);
+		if(function == NULL || function->HasTargetObject() == false)
+			return 0;
+		reader >> id;
+		return id;
+	}
+	
+	NodeId ObjectRegistry::GetForwardTarget(ObjectId id) {
+		ObjectRegistry& registry = Singleton();
+		ObjectGuard guard;
+		if(registry.table.Get(id))
+			return 0;
+		const NodeId owner = GetOwner(id);
+		return owner == registry.localNode ? 0 : owner;
+	}
+	
+	void ObjectRegistry::WriteLocationHint(serialization::Writer& writer,
+			ObjectId id, NodeId node) {
+		rpc::Function<decltype(&impl::LocationHint), impl::LocationHint>
+			::PrepareOneWayCall(writer, id, node);
+	}
+	
+	void ObjectRegistry::WriteLocationMiss(serialization::Writer& writer,
+			ObjectId id) {
+		rpc::Function<decltype(&impl::LocationMiss), impl::LocationMiss>
+			::PrepareOneWayCall(writer, id, Singleton().localNode.load());
+	}
+}
+
@@ -0,0 +1,222 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_OBJECT_REGISTRY_HPP
+#define DORPC_RMI_OBJECT_REGISTRY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <cinttypes>
+
+#include "../networking/Buffer.hpp"
+#include "../serialization/serializator.hpp"
+#include "Object.hpp"
+#include "ObjectTable.hpp"
+#include "RangeMap.hpp"
+#include "LocationCache.hpp"
+
+namespace rpc {
+	class FunctionTranslation;
+}
+
+namespace rmi {
+	class Snapshot;
+	
+	/*
+	 * Objects of this node and locations of all known id ranges, see README
+	 * "Solution 3". Objects may migrate between nodes: origin node of the id
+	 * range and every node the object left keep its next location and
+	 * forward calls, callers learn current owner from location hints. Thread
+	 * safe.
+	 */
+	class ObjectRegistry {
+	public:
+		
+		static ObjectRegistry& Singleton();
+		
+		using Factory = Object*(*)();
+		template<typename T>
+		static void RegisterType(const char* name) {
+			RegisterType(typeid(T), name, []()->Object* { return new T(); });
+		}
+		static void RegisterType(const std::type_info& type,
+				const std::string& name, Factory factory);
+		static bool GetTypeName(const Object* object, std::string& name);
+		
+		static void SetLocalNode(NodeId node);
+		static NodeId GetLocalNode();
+		
+		// Range [begin, end) of ids which this node may allocate.
+		static void AddLocalRange(ObjectId begin, ObjectId end);
+		// Range [begin, end) allocated by other node.
+		static void AddRemoteRange(ObjectId begin, ObjectId end, NodeId node);
+		
+		// Ids leased by leader at once and taken by one thread at once.
+		static constexpr ObjectId LEASE_SIZE = 1<<20;
+		static constexpr ObjectId THREAD_BLOCK = 1<<10;
+		// Unanswered lease request is repeated after this time.
+		static constexpr int64_t LEASE_TIMEOUT_MS = 5000;
+		
+		// Node which leases id ranges to other nodes, 0 disables leasing.
+		static void SetLeader(NodeId leader);
+		static NodeId GetLeader();
+		// Leader only, ids [begin, end) which are leased to nodes.
+		static void SetLeaseSpace(ObjectId begin, ObjectId end);
+		// Sends one-way call to node, node 0 means all other nodes. Carries
+		// lease requests and announcements of granted leases.
+		static void SetLeaseTransport(
+				std::function<void(NodeId, serialization::Writer&)> send);
+		// Asks leader for next range. Called automatically when less than
+		// LEASE_SIZE/2 leased ids are left, new node should call it once
+		// at start.
+		static void RequestLease();
+		// Leader only, leases next range to node and announces it.
+		static bool GrantLease(NodeId node);
+		static void OnLeaseGranted(NodeId node, ObjectId begin, ObjectId end);
+		// Leased ids not yet taken by any thread.
+		static ObjectId GetFreeIdCount();
+		
+		// Node connected through the link of frames dispatched by this
+		// thread, set by application before FunctionRegistry::Dispatch of
+		// frames received from other nodes. Lease requests and
+		// announcements with unknown (0) or mismatched sender are ignored.
+		static void SetSenderNode(NodeId node);
+		static NodeId GetSenderNode();
+		
+		// Assigns new id from thread local block of local ranges, returns 0
+		// when they are exhausted, then caller keeps ownership of object.
+		// Never waits for leader.
+		static ObjectId Add(Object* object);
+		// Inserts object with already assigned id.
+		static bool Insert(ObjectId id, Object* object);
+		// Returned object may still be used by threads which got it from Get,
+		// delete it directly only when no other thread uses the registry.
+		static Object* Remove(ObjectId id);
+		// Removes object and deletes it once no ObjectGuard references it.
+		static bool Destroy(ObjectId id);
+		
+		// Objects missing in the table are rehydrated from attached
+		// snapshot, if any. Returned object is valid only while ObjectGuard
+		// created before the call exists on this thread.
+		inline static Object* Get(ObjectId id) {
+			ObjectRegistry& registry = Singleton();
+			Object* object = registry.table.Get(id);
+			if(object == NULL
+					&& registry.snapshot.load(std::memory_order_relaxed))
+				return InternalLoad(id);
+			return object;
+		}
+		
+		// Node which should receive calls of object according to this node:
+		// this node for local objects, next node for objects which migrated
+		// from here, otherwise origin node of the id range or 0 if unknown.
+		static NodeId GetOwner(ObjectId id);
+		// Caller side choice of node: cached location or GetOwner.
+		static NodeId Route(ObjectId id);
+		
+		// Moves local object to target node and retires local instance.
+		// Writes one-way call importing the object, to be sent to target.
+		// When origin node of the object is neither this node nor target,
+		// also writes one-way call updating its metadata to originCall and
+		// sets originNode, otherwise originNode is 0.
+		static bool Migrate(ObjectId id, NodeId target,
+				serialization::Writer& importCall,
+				serialization::Writer& originCall, NodeId& originNode);
+		// Fails for ids outside of known ranges.
+		static bool Import(ObjectId id, const std::string& type,
+				std::string_view state);
+		// Records next location of object which migrated from this node,
+		// local node clears it.
+		static void SetLocation(ObjectId id, NodeId node);
+		// Location received from other node, accepted only for objects
+		// which migrated from this node or which ids this node allocated.
+		static bool UpdateLocation(ObjectId id, NodeId node);
+		
+		// Returns target object of rmi method call frame, 0 for other frames.
+		static ObjectId PeekTargetObject(networking::Buffer& call,
+				const rpc::FunctionTranslation* translation = NULL);
+		// Node to which call of object should be forwarded, 0 if object is
+		// local or unknown.
+		static NodeId GetForwardTarget(ObjectId id);
+		// One-way call updating LocationCache of the caller, sent by node
+		// which forwarded its call.
+		static void WriteLocationHint(serialization::Writer& writer,
+				ObjectId id, NodeId node);
+		// One-way call dropping cached location of the caller, sent by node
+		// which received call of object it neither has nor can forward
+		// (Dispatch returned CALL_TARGET_NOT_FOUND and GetForwardTarget 0).
+		static void WriteLocationMiss(serialization::Writer& writer,
+				ObjectId id);
+		
+		// Used by Snapshot::Attach and Snapshot::Detach.
+		static void SetSnapshot(Snapshot* snapshot);
+		
+		inline static ObjectTable& GetTable() { return Singleton().table; }
+		inline static RangeMap& GetRanges() { return Singleton().ranges; }
+		inline static LocationCache& GetLocationCache() {
+			return Singleton().locationCache;
+		}
+		
+	private:
+		
+		ObjectRegistry();
+		
+		ObjectTable table;
+		RangeMap ranges;
+		std::atomic<NodeId> localNode;
+		
+		bool InternalTakeBlock(ObjectId& begin, ObjectId& end);
+		static Object* InternalLoad(ObjectId id);
+		
+		std::mutex allocationMutex;
+		// Not yet allocated parts of local ranges, [next, end).
+		std::deque<std::pair<ObjectId, ObjectId>> freeRanges;
+		ObjectId freeIds;
+		bool leasePending;
+		std::chrono::steady_clock::time_point leaseRequestedAt;
+		std::atomic<NodeId> leaderNode;
+		// Leader only, not yet leased ids.
+		std::pair<ObjectId, ObjectId> leaseSpace;
+		std::function<void(NodeId, serialization::Writer&)> leaseTransport;
+		
+		std::mutex locationsMutex;
+		// Next location of objects which migrated from this node.
+		std::unordered_map<ObjectId, NodeId> delegated;
+		LocationCache locationCache;
+		
+		std::mutex typesMutex;
+		std::unordered_map<std::type_index, std::string> typeNames;
+		std::unordered_map<std::string, Factory> factories;
+		
+		std::atomic<Snapshot*> snapshot;
+	};
+}
+
+#define REGISTER_OBJECT_TYPE(__C) rmi::ObjectRegistry::RegisterType<__C>(#__C)
+
+#endif
+
@@ -0,0 +1,115 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ObjectGuard.hpp"
+
+#include "ObjectTable.hpp"
+
+namespace rmi {
+	
+	ObjectTable::ObjectTable() : count(0) {
+		directory = MakeDirectory(16);
+	}
+	
+	ObjectTable::~ObjectTable() {
+		const Directory* d = directory.load();
+		for(uint64_t i=0; i<=d->mask; ++i)
+			delete d->slots[i].load();
+		DeleteDirectory((void*)d);
+	}
+	
+	ObjectTable::Directory* ObjectTable::MakeDirectory(uint64_t slots) {
+		Directory* d = new Directory;
+		d->mask = slots - 1;
+		d->used = 0;
+		d->slots = new std::atomic<Chunk*>[slots];
+		for(uint64_t i=0; i<slots; ++i)
+			d->slots[i].store(NULL, std::memory_order_relaxed);
+		return d;
+	}
+	
+	void ObjectTable::DeleteDirectory(void* directory) {
+		Directory* d = (Directory*)directory;
+		delete[] d->slots;
+		delete d;
+	}
+	
+	void ObjectTable::Place(Directory* d, Chunk* chunk) {
+		uint64_t i = Hash(chunk->index);
+		while(d->slots[i & d->mask].load(std::memory_order_relaxed))
+			++i;
+		d->slots[i & d->mask].store(chunk, std::memory_order_release);
+		++d->used;
+	}
+	
+	ObjectTable::Chunk* ObjectTable::GetOrCreateChunk(uint64_t index) {
+		const Directory* old = directory.load(std::memory_order_relaxed);
+		Chunk* c = Find(old, index);
+		if(c)
+			return c;
+		Directory* d = (Directory*)old;
+		if((old->used+1)*2 > old->mask+1) {
+			d = MakeDirectory((old->mask+1)*2);
+			for(uint64_t i=0; i<=old->mask; ++i) {
+				Chunk* chunk = old->slots[i].load(std::memory_order_relaxed);
+				if(chunk)
+					Place(d, chunk);
+			}
+			directory.store(d, std::memory_order_release);
+			// Lock free readers may still probe the old directory.
+			ObjectGuard::Retire((void*)old, DeleteDirectory);
+		}
+		c = new Chunk;
+		c->index = index;
+		for(uint64_t i=0; i<CHUNK_SIZE; ++i)
+			c->objects[i].store(NULL, std::memory_order_relaxed);
+		Place(d, c);
+		return c;
+	}
+	
+	bool ObjectTable::Insert(ObjectId id, Object* object) {
+		if(id == 0 || object == NULL)
+			return false;
+		std::lock_guard<std::mutex> lock(mutex);
+		Chunk* c = GetOrCreateChunk(id >> CHUNK_BITS);
+		std::atomic<Object*>& entry = c->objects[id & (CHUNK_SIZE-1)];
+		if(entry.load(std::memory_order_relaxed))
+			return false;
+		entry.store(object, std::memory_order_release);
+		++count;
+		return true;
+	}
+	
+	Object* ObjectTable::Remove(ObjectId id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		Chunk* c = Find(directory.load(std::memory_order_relaxed),
+				id >> CHUNK_BITS);
+		if(c == NULL)
+			return NULL;
+		Object* object = c->objects[id & (CHUNK_SIZE-1)].exchange(NULL,
+				std::memory_order_acq_rel);
+		if(object)
+			--count;
+		return object;
+	}
+	
+	size_t ObjectTable::Size() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return count;
+	}
+}
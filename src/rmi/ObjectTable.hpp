@@ -0,0 +1,124 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_OBJECT_TABLE_HPP
+#define DORPC_RMI_OBJECT_TABLE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <cinttypes>
+#include <cstddef>
+
+#include "Object.hpp"
+
+namespace rmi {
+	/*
+	 * Chunked array of local objects indexed by object id. Chunks of
+	 * CHUNK_SIZE consecutive ids are found through open addressing hash
+	 * directory, so memory depends only on number of used chunks and any id
+	 * can be stored. Ids are handed out in large contiguous ranges, so
+	 * chunks are well filled. Chunks are never moved or freed before
+	 * destruction, so entry addresses are stable. Get is lock free,
+	 * modifications are serialised with a mutex and grow the directory RCU
+	 * style, replaced directories are freed through ObjectGuard::Retire.
+	 */
+	class ObjectTable {
+	public:
+		
+		static constexpr int CHUNK_BITS = 12;
+		static constexpr uint64_t CHUNK_SIZE = 1ull << CHUNK_BITS;
+		
+		ObjectTable();
+		~ObjectTable();
+		
+		// Caller holds ObjectGuard, which also keeps the directory alive.
+		inline Object* Get(ObjectId id) const {
+			Chunk* c = Find(directory.load(std::memory_order_acquire),
+					id >> CHUNK_BITS);
+			if(c == NULL)
+				return NULL;
+			return c->objects[id & (CHUNK_SIZE-1)].load(
+					std::memory_order_acquire);
+		}
+		
+		// Returns false if id is 0 or already used.
+		bool Insert(ObjectId id, Object* object);
+		Object* Remove(ObjectId id);
+		
+		size_t Size() const;
+		
+		// Calls func(id, object) for every object, under the table mutex.
+		template<typename F>
+		void ForEach(F&& func) const {
+			std::lock_guard<std::mutex> lock(mutex);
+			const Directory* d = directory.load(std::memory_order_relaxed);
+			for(uint64_t i=0; i<=d->mask; ++i) {
+				Chunk* c = d->slots[i].load(std::memory_order_relaxed);
+				if(c == NULL)
+					continue;
+				for(uint64_t j=0; j<CHUNK_SIZE; ++j) {
+					Object* object = c->objects[j].load(
+							std::memory_order_relaxed);
+					if(object)
+						func((c->index<<CHUNK_BITS) | j, object);
+				}
+			}
+		}
+		
+	private:
+		
+		struct Chunk {
+			uint64_t index;
+			std::atomic<Object*> objects[CHUNK_SIZE];
+		};
+		
+		// Slots are never cleared, so lookup stops at first empty slot.
+		// At most half of the slots are used.
+		struct Directory {
+			uint64_t mask;
+			uint64_t used;
+			std::atomic<Chunk*>* slots;
+		};
+		
+		inline static uint64_t Hash(uint64_t index) {
+			return (index * 0x9E3779B97F4A7C15ull) >> 32;
+		}
+		
+		inline static Chunk* Find(const Directory* d, uint64_t index) {
+			for(uint64_t i=Hash(index);; ++i) {
+				Chunk* c = d->slots[i & d->mask].load(
+						std::memory_order_acquire);
+				if(c == NULL || c->index == index)
+					return c;
+			}
+		}
+		
+		static Directory* MakeDirectory(uint64_t slots);
+		static void DeleteDirectory(void* directory);
+		static void Place(Directory* d, Chunk* chunk);
+		
+		Chunk* GetOrCreateChunk(uint64_t index);
+		
+		std::atomic<const Directory*> directory;
+		mutable std::mutex mutex;
+		size_t count;
+	};
+}
+
+#endif
+
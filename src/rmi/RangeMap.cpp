@@ -0,0 +1,77 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <mutex>
+
+#include "RangeMap.hpp"
+
+namespace rmi {
+	
+	void RangeMap::Add(ObjectId begin, ObjectId end, NodeId node) {
+		if(begin >= end)
+			return;
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		InternalRemove(begin, end);
+		ranges[begin] = Range{end, node};
+	}
+	
+	void RangeMap::Remove(ObjectId begin, ObjectId end) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		InternalRemove(begin, end);
+	}
+	
+	void RangeMap::InternalRemove(ObjectId begin, ObjectId end) {
+		auto it = ranges.lower_bound(begin);
+		if(it != ranges.begin()) {
+			// Range starting before begin may overlap it.
+			auto prev = std::prev(it);
+			if(prev->second.end > begin) {
+				Range range = prev->second;
+				prev->second.end = begin;
+				if(range.end > end)
+					ranges[end] = range;
+			}
+		}
+		while(it != ranges.end() && it->first < end) {
+			if(it->second.end > end) {
+				Range range = it->second;
+				it = ranges.erase(it);
+				ranges[end] = range;
+				break;
+			}
+			it = ranges.erase(it);
+		}
+	}
+	
+	NodeId RangeMap::Find(ObjectId id) const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto it = ranges.upper_bound(id);
+		if(it == ranges.begin())
+			return 0;
+		--it;
+		if(id < it->second.end)
+			return it->second.node;
+		return 0;
+	}
+	
+	size_t RangeMap::Size() const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return ranges.size();
+	}
+}
+
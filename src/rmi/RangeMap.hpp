@@ -0,0 +1,67 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_RANGE_MAP_HPP
+#define DORPC_RMI_RANGE_MAP_HPP
+
+#include <map>
+#include <shared_mutex>
+#include <cinttypes>
+
+#include "Object.hpp"
+
+namespace rmi {
+	/*
+	 * Maps ranges of object ids to nodes which allocated them (origin nodes).
+	 * Ranges are large, so the map stays small. Thread safe.
+	 */
+	class RangeMap {
+	public:
+		
+		// Range [begin, end). Overlapping ranges are replaced.
+		void Add(ObjectId begin, ObjectId end, NodeId node);
+		void Remove(ObjectId begin, ObjectId end);
+		// Returns 0 for ids outside of all ranges.
+		NodeId Find(ObjectId id) const;
+		size_t Size() const;
+		
+		// Calls func(begin, end, node) for every range, under the lock.
+		template<typename F>
+		void ForEach(F&& func) const {
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			for(auto& it : ranges)
+				func(it.first, it.second.end, it.second.node);
+		}
+		
+	private:
+		
+		struct Range {
+			ObjectId end;
+			NodeId node;
+		};
+		
+		void InternalRemove(ObjectId begin, ObjectId end);
+		
+		mutable std::shared_mutex mutex;
+		// Keyed by first id of range.
+		std::map<ObjectId, Range> ranges;
+	};
+}
+
+#endif
+
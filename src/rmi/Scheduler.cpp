@@ -0,0 +1,220 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "../rpc/FunctionRegistry.hpp"
+#include "../rpc/FunctionTranslation.hpp"
+
+#include "Scheduler.hpp"
+
+namespace rmi {
+	
+	Mailbox::~Mailbox() {
+		networking::Task* task;
+		while((task = calls.pop()) != NULL)
+			networking::Task::Free(task);
+	}
+	
+	Scheduler::Scheduler(uint32_t count) : running(true), stolen(0) {
+		if(count == 0)
+			count = std::max(1u, std::thread::hardware_concurrency());
+		workers.resize(count);
+		for(Worker*& worker : workers) {
+			worker = new Worker();
+			worker->sleeping = false;
+		}
+		for(uint32_t i=0; i<count; ++i)
+			workers[i]->thread = std::thread(&Scheduler::InternalRun, this, i);
+	}
+	
+	Scheduler::~Scheduler() {
+		Stop();
+		// Posts which raced with Stop.
+		InternalDrop();
+		for(Worker* worker : workers)
+			delete worker;
+	}
+	
+	void Scheduler::Stop() {
+		if(running.exchange(false) == false)
+			return;
+		for(Worker* worker : workers) {
+			std::lock_guard<std::mutex> lock(worker->sleepMutex);
+			worker->wakeup.notify_one();
+		}
+		for(Worker* worker : workers)
+			worker->thread.join();
+		InternalDrop();
+	}
+	
+	void Scheduler::InternalDrop() {
+		for(Worker* worker : workers) {
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			Mailbox* mailbox;
+			while((mailbox = worker->inbox.pop()) != NULL)
+				worker->ready.push_back(mailbox);
+			for(Mailbox* it : worker->ready) {
+				networking::Task* task;
+				while((task = it->calls.pop()) != NULL)
+					networking::Task::Free(task);
+				// Idle mailbox is scheduled again by next post, possibly to
+				// other Scheduler.
+				it->pending.store(0, std::memory_order_release);
+				it->Release();
+			}
+			worker->ready.clear();
+		}
+	}
+	
+	Mailbox* Scheduler::InternalGetMailbox(Object* object) {
+		Mailbox* mailbox = object->mailbox.load(std::memory_order_acquire);
+		if(mailbox)
+			return mailbox;
+		Mailbox* created = new Mailbox();
+		if(object->mailbox.compare_exchange_strong(mailbox, created,
+					std::memory_order_acq_rel))
+			return created;
+		delete created;
+		return mailbox;
+	}
+	
+	bool Scheduler::Post(Object* object, networking::Task* task) {
+		if(running.load() == false) {
+			networking::Task::Free(task);
+			return false;
+		}
+		Mailbox* mailbox = InternalGetMailbox(object);
+		// Counted before it is pushed, so pending never drops below number
+		// of queued tasks. Worker which finds it not yet pushed keeps the
+		// mailbox scheduled.
+		const uint32_t previous = mailbox->pending.fetch_add(1,
+				std::memory_order_acq_rel);
+		mailbox->calls.push(task);
+		if(previous != 0)
+			return true;
+		// Mailbox was idle, now it is owned by ready queue of home worker.
+		mailbox->Acquire();
+		Worker* worker = workers[GetHomeWorker(object->GetObjectId())];
+		worker->inbox.push(mailbox);
+		if(worker->sleeping.load()) {
+			std::lock_guard<std::mutex> lock(worker->sleepMutex);
+			worker->wakeup.notify_one();
+		}
+		return true;
+	}
+	
+	bool Scheduler::PostCall(networking::Buffer& call,
+			std::function<void(serialization::Writer&)> onReturn,
+			const rpc::FunctionTranslation* translation) {
+		if(running.load() == false)
+			return false;
+		ObjectGuard guard;
+		Object* object = ObjectRegistry::Get(
+				ObjectRegistry::PeekTargetObject(call, translation));
+		if(object == NULL)
+			return false;
+		// Translation belongs to the connection, which may close before the
+		// task runs, so function id is translated now.
+		if(translation) {
+			serialization::Reader reader(call);
+			uint32_t functionId = 0;
+			reader >> functionId;
+			const uint32_t oneWay = functionId & rpc::FunctionBase::ONE_WAY_FLAG;
+			serialization::Writer writer;
+			writer << (translation->ToLocal(functionId & ~oneWay) | oneWay);
+			memcpy(call.Data(), writer.GetBuffer().Data(), sizeof(uint32_t));
+		}
+		return Post(object, networking::Task::Make([buffer = std::move(call),
+					onReturn = std::move(onReturn)]() mutable {
+				serialization::Reader reader(buffer);
+				serialization::Writer writer;
+				if(rpc::FunctionRegistry::Dispatch(reader, writer)
+						== rpc::FunctionRegistry::CALL_RETURNED && onReturn)
+					onReturn(writer);
+				}));
+	}
+	
+	Mailbox* Scheduler::InternalTake(Worker& worker, bool steal) {
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		Mailbox* mailbox;
+		while((mailbox = worker.inbox.pop()) != NULL)
+			worker.ready.push_back(mailbox);
+		if(worker.ready.empty())
+			return NULL;
+		if(steal) {
+			mailbox = worker.ready.back();
+			worker.ready.pop_back();
+		} else {
+			mailbox = worker.ready.front();
+			worker.ready.pop_front();
+		}
+		return mailbox;
+	}
+	
+	Mailbox* Scheduler::InternalNext(uint32_t index) {
+		Mailbox* mailbox = InternalTake(*workers[index], false);
+		if(mailbox)
+			return mailbox;
+		for(uint32_t i=1; i<workers.size(); ++i) {
+			mailbox = InternalTake(*workers[(index+i) % workers.size()], true);
+			if(mailbox) {
+				stolen.fetch_add(1, std::memory_order_relaxed);
+				return mailbox;
+			}
+		}
+		return NULL;
+	}
+	
+	void Scheduler::InternalRun(uint32_t index) {
+		Worker& self = *workers[index];
+		while(running) {
+			Mailbox* mailbox = InternalNext(index);
+			if(mailbox == NULL) {
+				std::unique_lock<std::mutex> lock(self.sleepMutex);
+				self.sleeping = true;
+				// Checked again after announcing sleep, so Post either sees
+				// sleeping worker or its mailbox is found here.
+				mailbox = InternalNext(index);
+				if(mailbox == NULL && running)
+					self.wakeup.wait_for(lock, std::chrono::milliseconds(10));
+				self.sleeping = false;
+				if(mailbox == NULL)
+					continue;
+			}
+			uint32_t executed = 0;
+			networking::Task* task;
+			while(executed < BATCH && (task = mailbox->calls.pop()) != NULL) {
+				task->Run();
+				networking::Task::Free(task);
+				++executed;
+			}
+			if(mailbox->pending.fetch_sub(executed, std::memory_order_acq_rel)
+					== executed) {
+				mailbox->Release();
+			} else {
+				// Includes tasks counted by Post but not yet pushed.
+				std::lock_guard<std::mutex> lock(self.mutex);
+				self.ready.push_back(mailbox);
+			}
+		}
+	}
+}
+
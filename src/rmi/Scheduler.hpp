@@ -0,0 +1,150 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_SCHEDULER_HPP
+#define DORPC_RMI_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cinttypes>
+
+#include <mpsc_queue.hpp>
+
+#include "../networking/Task.hpp"
+#include "../serialization/serializator.hpp"
+#include "Object.hpp"
+#include "ObjectRegistry.hpp"
+#include "ObjectGuard.hpp"
+
+namespace rpc {
+	class FunctionTranslation;
+}
+
+namespace rmi {
+	/*
+	 * Calls of one object waiting for execution. Mailbox is in at most one
+	 * ready queue at a time, so calls of one object never run concurrently.
+	 * Referenced by its object and by the ready queue holding it.
+	 */
+	class Mailbox : public concurrent::node<Mailbox> {
+	public:
+		
+		Mailbox() : pending(0), references(1) {}
+		~Mailbox();
+		
+		inline void Acquire() {
+			references.fetch_add(1, std::memory_order_relaxed);
+		}
+		
+		inline void Release() {
+			if(references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete this;
+		}
+		
+		concurrent::mpsc::queue<networking::Task> calls;
+		std::atomic<uint32_t> pending;
+		std::atomic<uint32_t> references;
+	};
+	
+	/*
+	 * Actor style executor of object calls. Every object has a home worker
+	 * chosen by hash of its id and calls of one object run serially without
+	 * locks. Idle workers steal whole objects (with all their pending calls)
+	 * from other workers. Mailbox is stored in the object, so an object may
+	 * be posted to only one Scheduler at a time, other Scheduler may use it
+	 * after Stop of the previous one.
+	 */
+	class Scheduler {
+	public:
+		
+		// Calls of one object executed before other objects get a chance.
+		static constexpr uint32_t BATCH = 64;
+		
+		// 0 workers means one per hardware thread.
+		Scheduler(uint32_t workers = 0);
+		~Scheduler();
+		
+		// Returns false when object is not local or scheduler is stopped.
+		template<typename F>
+		inline bool Post(ObjectId id, F&& call) {
+			if(running.load() == false)
+				return false;
+			ObjectGuard guard;
+			Object* object = ObjectRegistry::Get(id);
+			if(object == NULL)
+				return false;
+			return Post(object, networking::Task::Make(std::forward<F>(call)));
+		}
+		// Caller keeps object alive, see ObjectGuard. Task is freed without
+		// running when scheduler is stopped.
+		bool Post(Object* object, networking::Task* task);
+		
+		// Executes rmi method call frame on worker of its target object,
+		// onReturn receives response of returning calls. Returns false and
+		// leaves call untouched when target object is not local or scheduler
+		// is stopped. Translation is used only during this call.
+		bool PostCall(networking::Buffer& call,
+				std::function<void(serialization::Writer&)> onReturn = NULL,
+				const rpc::FunctionTranslation* translation = NULL);
+		
+		// Stops workers, calls not yet executed are dropped and later posts
+		// are rejected.
+		void Stop();
+		
+		inline uint32_t GetWorkerCount() const { return workers.size(); }
+		inline uint64_t GetStolenCount() const {
+			return stolen.load(std::memory_order_relaxed);
+		}
+		inline uint32_t GetHomeWorker(ObjectId id) const {
+			return ((id * 0x9E3779B97F4A7C15ull) >> 32) % workers.size();
+		}
+		
+	private:
+		
+		struct Worker {
+			// Objects scheduled by other threads, lock free.
+			concurrent::mpsc::queue<Mailbox> inbox;
+			// Guards ready and pops from inbox, which may be done by thieves.
+			std::mutex mutex;
+			std::deque<Mailbox*> ready;
+			std::mutex sleepMutex;
+			std::condition_variable wakeup;
+			std::atomic<bool> sleeping;
+			std::thread thread;
+		};
+		
+		Mailbox* InternalGetMailbox(Object* object);
+		Mailbox* InternalTake(Worker& worker, bool steal);
+		Mailbox* InternalNext(uint32_t index);
+		// Drops calls of scheduled objects, workers must not be running.
+		void InternalDrop();
+		void InternalRun(uint32_t index);
+		
+		std::vector<Worker*> workers;
+		std::atomic<bool> running;
+		std::atomic<uint64_t> stolen;
+	};
+}
+
+#endif
+
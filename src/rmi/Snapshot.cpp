@@ -0,0 +1,503 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ObjectRegistry.hpp"
+#include "ObjectGuard.hpp"
+#include "Scheduler.hpp"
+
+#include "Snapshot.hpp"
+
+namespace rmi {
+	
+	namespace impl {
+		// Length, id and lengths of type name and state.
+		static const uint64_t MIN_RECORD = 4 + 8 + 4 + 4;
+		// Id 0, empty type name and state of begin, end and origin node.
+		static const uint64_t RANGE_RECORD = MIN_RECORD + 8 + 8 + 4;
+		
+		inline uint64_t ReadLittleEndian(const uint8_t* data, int bytes) {
+			uint64_t v = 0;
+			for(int i=0; i<bytes; ++i)
+				v |= ((uint64_t)data[i]) << (i*8);
+			return v;
+		}
+		
+		static bool WriteAll(int fd, const uint8_t* data, size_t bytes) {
+			while(bytes) {
+				ssize_t written = write(fd, data, bytes);
+				if(written <= 0)
+					return false;
+				data += written;
+				bytes -= written;
+			}
+			return true;
+		}
+	}
+	
+	Snapshot::Snapshot() : fd(-1), data(NULL), capacity(0), pending(0) {
+	}
+	
+	Snapshot::~Snapshot() {
+		InternalUnmap();
+		if(fd >= 0)
+			close(fd);
+	}
+	
+	Snapshot* Snapshot::Open(const char* path) {
+		Snapshot* snapshot = new Snapshot();
+		snapshot->path = path;
+		snapshot->fd = open(path, O_RDWR | O_CREAT, 0600);
+		struct stat st;
+		if(snapshot->fd < 0 || fstat(snapshot->fd, &st) != 0) {
+			delete snapshot;
+			return NULL;
+		}
+		if((uint64_t)st.st_size < sizeof(Header)) {
+			if(ftruncate(snapshot->fd, INITIAL_CAPACITY) != 0
+					|| snapshot->InternalMap(INITIAL_CAPACITY) == false) {
+				delete snapshot;
+				return NULL;
+			}
+			*snapshot->InternalHeader() = Header{MAGIC, VERSION,
+				sizeof(Header), 0};
+			return snapshot;
+		}
+		if(snapshot->InternalMap(st.st_size) == false
+				|| snapshot->InternalIndex() == false) {
+			delete snapshot;
+			return NULL;
+		}
+		return snapshot;
+	}
+	
+	void Snapshot::Attach() {
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			const RangeMap& known = ObjectRegistry::GetRanges();
+			for(const StoredRange& range : ranges)
+				// Ranges already known to the registry are newer.
+				if(known.Find(range.begin) == 0
+						&& known.Find(range.end - 1) == 0)
+					ObjectRegistry::AddRemoteRange(range.begin, range.end,
+							range.node);
+		}
+		ObjectRegistry::SetSnapshot(this);
+	}
+	
+	void Snapshot::Detach() {
+		ObjectRegistry::SetSnapshot(NULL);
+	}
+	
+	void Snapshot::MarkDirty(ObjectId id) {
+		std::lock_guard<std::mutex> lock(dirtyMutex);
+		dirty[id] = false;
+	}
+	
+	void Snapshot::MarkRemoved(ObjectId id) {
+		{
+			std::unique_lock<std::shared_mutex> lock(mutex);
+			auto entry = latest.find(id);
+			if(entry != latest.end() && entry->second != REMOVED) {
+				if((entry->second & REHYDRATED) == 0)
+					--pending;
+				entry->second = REMOVED;
+			}
+		}
+		std::lock_guard<std::mutex> lock(dirtyMutex);
+		dirty[id] = true;
+	}
+	
+	int64_t Snapshot::Write(Scheduler* scheduler) {
+		std::unordered_map<ObjectId, bool> changes;
+		if(GetFileSize() == 0)
+			return -1;
+		{
+			std::lock_guard<std::mutex> lock(dirtyMutex);
+			changes.swap(dirty);
+		}
+		
+		// Records are encoded without holding the lock, objects on their
+		// workers when scheduler is given.
+		struct Record {
+			ObjectId id;
+			bool removed;
+			bool encoded = false;
+			serialization::Writer writer;
+		};
+		std::vector<Record> records(changes.size());
+		std::mutex doneMutex;
+		std::condition_variable done;
+		size_t remaining = 0;
+		size_t index = 0;
+		for(auto& it : changes) {
+			Record& record = records[index++];
+			record.id = it.first;
+			record.removed = it.second;
+			if(record.removed) {
+				record.encoded = InternalEncode(record.writer, record.id, NULL);
+				continue;
+			}
+			auto encode = [this, &record]() {
+				ObjectGuard guard;
+				Object* object = ObjectRegistry::GetTable().Get(record.id);
+				record.encoded = object
+					&& InternalEncode(record.writer, record.id, object);
+			};
+			if(scheduler) {
+				{
+					std::lock_guard<std::mutex> lock(doneMutex);
+					++remaining;
+				}
+				if(scheduler->Post(record.id, [&, encode]() {
+							encode();
+							std::lock_guard<std::mutex> lock(doneMutex);
+							if(--remaining == 0)
+								done.notify_one();
+						}))
+					continue;
+				std::lock_guard<std::mutex> lock(doneMutex);
+				--remaining;
+			}
+			encode();
+		}
+		{
+			std::unique_lock<std::mutex> lock(doneMutex);
+			done.wait(lock, [&remaining]() { return remaining == 0; });
+		}
+		
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		ObjectGuard guard;
+		uint64_t end = InternalHeader()->end;
+		// Records with their offsets, applied to latest once durable.
+		std::vector<std::pair<const Record*, uint64_t>> appended;
+		bool failed = false;
+		for(Record& record : records) {
+			if(record.encoded == false)
+				continue;
+			if(record.removed) {
+				// Tombstone is needed only to hide record already in file.
+				auto entry = latest.find(record.id);
+				if(entry == latest.end() || entry->second != REMOVED)
+					continue;
+			} else if(ObjectRegistry::GetTable().Get(record.id) == NULL) {
+				// Removed meanwhile, its tombstone is written next time.
+				continue;
+			}
+			const uint64_t offset = end;
+			if(InternalAppend(end, record.writer.GetBuffer()) == false) {
+				failed = true;
+				break;
+			}
+			appended.emplace_back(&record, offset);
+		}
+		// Ranges are recorded so that a restarted process can import the
+		// records.
+		std::vector<StoredRange> newRanges;
+		if(failed == false) {
+			ObjectRegistry::GetRanges().ForEach([&](ObjectId begin,
+						ObjectId end, NodeId node) {
+					const StoredRange range{begin, end, node};
+					if(std::find(ranges.begin(), ranges.end(), range)
+							== ranges.end())
+						newRanges.push_back(range);
+				});
+			serialization::Writer record;
+			for(const StoredRange& range : newRanges) {
+				InternalEncodeRange(record, range);
+				if(InternalAppend(end, record.GetBuffer()) == false) {
+					failed = true;
+					break;
+				}
+			}
+		}
+		
+		// Records become valid only after they are durable.
+		Header* header = InternalHeader();
+		if(failed == false && msync(data, end, MS_SYNC) == 0) {
+			for(auto& it : appended) {
+				const ObjectId id = it.first->id;
+				auto entry = latest.find(id);
+				if(it.first->removed) {
+					latest.erase(entry);
+					continue;
+				}
+				if(entry != latest.end() && entry->second != REMOVED
+						&& (entry->second & REHYDRATED) == 0)
+					--pending;
+				latest[id] = it.second | REHYDRATED;
+			}
+			ranges.insert(ranges.end(), newRanges.begin(), newRanges.end());
+			header->end = end;
+			header->records += appended.size() + newRanges.size();
+			failed = msync(data, sizeof(Header), MS_SYNC) != 0;
+		} else {
+			failed = true;
+		}
+		
+		if(failed) {
+			std::lock_guard<std::mutex> lock(dirtyMutex);
+			for(auto& it : changes)
+				dirty.emplace(it.first, it.second);
+			return -1;
+		}
+		if(header->records > latest.size()*2 + 1024)
+			InternalCompact();
+		return appended.size();
+	}
+	
+	bool Snapshot::Compact() {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		return InternalCompact();
+	}
+	
+	Object* Snapshot::Rehydrate(ObjectId id) {
+		{
+			// Most misses are ids without record or already created objects.
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			auto entry = latest.find(id);
+			if(entry == latest.end() || entry->second == REMOVED
+					|| data == NULL || ((entry->second & REHYDRATED)
+						&& loading.count(id) == 0))
+				return ObjectRegistry::GetTable().Get(id);
+		}
+		networking::Buffer record;
+		for(;;) {
+			{
+				std::unique_lock<std::shared_mutex> lock(mutex);
+				auto entry = latest.find(id);
+				if(entry == latest.end() || entry->second == REMOVED
+						|| data == NULL)
+					return ObjectRegistry::GetTable().Get(id);
+				if((entry->second & REHYDRATED) == 0) {
+					const uint64_t offset = entry->second;
+					record.Write(data + offset,
+							impl::ReadLittleEndian(data + offset, 4));
+					entry->second |= REHYDRATED;
+					--pending;
+					loading.insert(id);
+					break;
+				}
+				if(loading.count(id) == 0)
+					return ObjectRegistry::GetTable().Get(id);
+			}
+			std::this_thread::yield();
+		}
+		
+		serialization::Reader reader(record);
+		uint32_t length = 0;
+		ObjectId recordId = 0;
+		std::string type;
+		std::string_view state;
+		reader >> length >> recordId >> type >> state;
+		const bool imported = ObjectRegistry::Import(id, type, state);
+		
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		loading.erase(id);
+		if(imported == false) {
+			// Kept pending, its type or range may become known later.
+			auto entry = latest.find(id);
+			if(entry != latest.end() && entry->second != REMOVED
+					&& (entry->second & REHYDRATED)) {
+				entry->second &= ~REHYDRATED;
+				++pending;
+			}
+			return NULL;
+		}
+		return ObjectRegistry::GetTable().Get(id);
+	}
+	
+	bool Snapshot::Contains(ObjectId id) const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto entry = latest.find(id);
+		return entry != latest.end() && entry->second != REMOVED;
+	}
+	
+	size_t Snapshot::GetPendingCount() const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return pending;
+	}
+	
+	uint64_t Snapshot::GetFileSize() const {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		if(data == NULL)
+			return 0;
+		return ((const Header*)data)->end;
+	}
+	
+	bool Snapshot::InternalMap(uint64_t size) {
+		InternalUnmap();
+		void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(ptr == MAP_FAILED)
+			return false;
+		data = (uint8_t*)ptr;
+		capacity = size;
+		return true;
+	}
+	
+	void Snapshot::InternalUnmap() {
+		if(data)
+			munmap(data, capacity);
+		data = NULL;
+		capacity = 0;
+	}
+	
+	bool Snapshot::InternalIndex() {
+		Header* header = InternalHeader();
+		if(capacity < sizeof(Header) || header->magic != MAGIC
+				|| header->version != VERSION || header->end < sizeof(Header)
+				|| header->end > capacity)
+			return false;
+		uint64_t offset = sizeof(Header);
+		while(offset + impl::MIN_RECORD <= header->end) {
+			const uint64_t length = impl::ReadLittleEndian(data + offset, 4);
+			if(length < impl::MIN_RECORD || offset + length > header->end)
+				break;
+			const ObjectId id = impl::ReadLittleEndian(data + offset + 4, 8);
+			if(id == 0) {
+				if(length >= impl::RANGE_RECORD) {
+					const StoredRange range{
+						impl::ReadLittleEndian(data + offset + 20, 8),
+						impl::ReadLittleEndian(data + offset + 28, 8),
+						(NodeId)impl::ReadLittleEndian(data + offset + 36, 4)};
+					if(std::find(ranges.begin(), ranges.end(), range)
+							== ranges.end())
+						ranges.push_back(range);
+				}
+				offset += length;
+				continue;
+			}
+			// Empty type name marks removed object.
+			if(impl::ReadLittleEndian(data + offset + 12, 4))
+				latest[id] = offset;
+			else
+				latest.erase(id);
+			offset += length;
+		}
+		header->end = offset;
+		pending = latest.size();
+		return true;
+	}
+	
+	bool Snapshot::InternalAppend(uint64_t& end, networking::Buffer& record) {
+		const uint64_t size = record.Size();
+		if(end + size > capacity) {
+			uint64_t newCapacity = std::max(capacity, INITIAL_CAPACITY);
+			while(newCapacity < end + size)
+				newCapacity *= 2;
+			if(ftruncate(fd, newCapacity) != 0)
+				return false;
+			void* ptr = mremap(data, capacity, newCapacity, MREMAP_MAYMOVE);
+			if(ptr == MAP_FAILED)
+				return false;
+			data = (uint8_t*)ptr;
+			capacity = newCapacity;
+		}
+		memcpy(data + end, record.Data(), size);
+		end += size;
+		return true;
+	}
+	
+	bool Snapshot::InternalEncode(serialization::Writer& record, ObjectId id,
+			const Object* object) {
+		std::string type;
+		if(object && ObjectRegistry::GetTypeName(object, type) == false)
+			return false;
+		record.GetBuffer().Clear();
+		record << (uint32_t)0 << id << type << (int32_t)0;
+		// State is serialized in place and its length patched afterwards.
+		const int32_t stateOffset = record.GetBuffer().Size();
+		if(object)
+			object->Serialize(record);
+		record.Patch<int32_t>(stateOffset - 4,
+				record.GetBuffer().Size() - stateOffset);
+		record.Patch<uint32_t>(0, record.GetBuffer().Size());
+		return true;
+	}
+	
+	void Snapshot::InternalEncodeRange(serialization::Writer& record,
+			const StoredRange& range) {
+		record.GetBuffer().Clear();
+		record << (uint32_t)impl::RANGE_RECORD << (ObjectId)0 << std::string()
+			<< (int32_t)(impl::RANGE_RECORD - impl::MIN_RECORD)
+			<< range.begin << range.end << range.node;
+	}
+	
+	bool Snapshot::InternalCompact() {
+		const std::string compactedPath = path + ".tmp";
+		int compactedFd = open(compactedPath.c_str(),
+				O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if(compactedFd < 0)
+			return false;
+		Header header{MAGIC, VERSION, sizeof(Header), 0};
+		std::unordered_map<ObjectId, uint64_t> compacted;
+		networking::Buffer out;
+		out.Write(&header, sizeof(Header));
+		bool valid = true;
+		serialization::Writer rangeRecord;
+		for(const StoredRange& range : ranges) {
+			InternalEncodeRange(rangeRecord, range);
+			out.Write(rangeRecord.GetBuffer().Data(),
+					rangeRecord.GetBuffer().Size());
+			header.end += rangeRecord.GetBuffer().Size();
+		}
+		// Latest records are copied as they are, objects changed after them
+		// are still marked dirty.
+		for(auto& it : latest) {
+			if(it.second == REMOVED)
+				continue;
+			const uint64_t offset = it.second & ~REHYDRATED;
+			const uint32_t length = impl::ReadLittleEndian(data + offset, 4);
+			compacted[it.first] = header.end | (it.second & REHYDRATED);
+			out.Write(data + offset, length);
+			header.end += length;
+			if(out.Size() >= (int32_t)INITIAL_CAPACITY) {
+				valid &= impl::WriteAll(compactedFd, out.Data(), out.Size());
+				out.Clear();
+			}
+		}
+		valid &= impl::WriteAll(compactedFd, out.Data(), out.Size());
+		header.records = compacted.size() + ranges.size();
+		const uint64_t size = std::max(header.end, INITIAL_CAPACITY);
+		valid = valid && pwrite(compactedFd, &header, sizeof(Header), 0)
+			== sizeof(Header) && ftruncate(compactedFd, size) == 0
+			&& fsync(compactedFd) == 0
+			&& rename(compactedPath.c_str(), path.c_str()) == 0;
+		if(valid == false) {
+			close(compactedFd);
+			unlink(compactedPath.c_str());
+			return false;
+		}
+		InternalUnmap();
+		close(fd);
+		fd = compactedFd;
+		latest.swap(compacted);
+		return InternalMap(size);
+	}
+}
+
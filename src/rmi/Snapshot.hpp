@@ -0,0 +1,151 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RMI_SNAPSHOT_HPP
+#define DORPC_RMI_SNAPSHOT_HPP
+
+#include <cinttypes>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../serialization/serializator.hpp"
+#include "Object.hpp"
+
+namespace rmi {
+	class Scheduler;
+	
+	/*
+	 * Memory mapped file with states of local objects. Write appends records
+	 * of objects marked dirty or removed since previous Write, latest record
+	 * of an object wins. Opening existing file only indexes its records, an
+	 * object is created from its record on first ObjectRegistry::Get of it.
+	 * Record is: 4 byte length, object id, type name and state, all in
+	 * serialization::Writer format. Records with id 0 hold id ranges of
+	 * ObjectRegistry with their origin nodes, Attach restores them so that
+	 * a restarted process can import recorded objects. Thread safe, but
+	 * objects must not be
+	 * modified while Write serializes them: when their calls run on a
+	 * Scheduler, pass it to Write. Periodic writes are left to the
+	 * application, Write blocks on msync so it should not run on a Loop.
+	 */
+	class Snapshot {
+	public:
+		
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			// End of last complete record, bytes after it are ignored.
+			uint64_t end;
+			uint64_t records;
+		};
+		
+		static constexpr uint32_t MAGIC = 0x504E5344;
+		static constexpr uint32_t VERSION = 2;
+		static constexpr uint64_t INITIAL_CAPACITY = 1<<20;
+		
+		// Opens or creates snapshot file, returns NULL on error.
+		static Snapshot* Open(const char* path);
+		~Snapshot();
+		
+		// Makes ObjectRegistry rehydrate missing objects from this snapshot
+		// and report removed objects to it. Recorded id ranges unknown to
+		// ObjectRegistry are added as remote ranges of their origin node.
+		// Detach before destruction.
+		void Attach();
+		void Detach();
+		
+		void MarkDirty(ObjectId id);
+		void MarkRemoved(ObjectId id);
+		
+		// Appends records of changed objects and makes them durable. Returns
+		// count of written records or -1 on error, then changes are kept for
+		// next Write. Compacts the file when most of its records are
+		// outdated. Objects are serialized on workers of given scheduler,
+		// so Write must not be called from one of them.
+		int64_t Write(Scheduler* scheduler = NULL);
+		// Rewrites file with only the latest record of every object.
+		bool Compact();
+		
+		// Creates object from its latest record, when not yet created, and
+		// inserts it into ObjectRegistry. Record which cannot be imported
+		// stays pending and is tried again by next call.
+		Object* Rehydrate(ObjectId id);
+		// True when file has record of object.
+		bool Contains(ObjectId id) const;
+		
+		// Objects with records which were not yet rehydrated.
+		size_t GetPendingCount() const;
+		uint64_t GetFileSize() const;
+		
+	private:
+		
+		// Set in offsets of records from which objects were created.
+		static constexpr uint64_t REHYDRATED = 1ull<<63;
+		// Object removed after its latest record, tombstone not yet written.
+		static constexpr uint64_t REMOVED = ~0ull;
+		
+		struct StoredRange {
+			ObjectId begin;
+			ObjectId end;
+			NodeId node;
+			
+			inline bool operator==(const StoredRange& other) const {
+				return begin == other.begin && end == other.end
+					&& node == other.node;
+			}
+		};
+		
+		Snapshot();
+		
+		inline Header* InternalHeader() { return (Header*)data; }
+		bool InternalMap(uint64_t size);
+		void InternalUnmap();
+		bool InternalIndex();
+		bool InternalAppend(uint64_t& end, networking::Buffer& record);
+		bool InternalEncode(serialization::Writer& record, ObjectId id,
+				const Object* object);
+		static void InternalEncodeRange(serialization::Writer& record,
+				const StoredRange& range);
+		bool InternalCompact();
+		
+		std::string path;
+		int fd;
+		uint8_t* data;
+		uint64_t capacity;
+		
+		mutable std::shared_mutex mutex;
+		// Offset of latest record of every object, with flags.
+		std::unordered_map<ObjectId, uint64_t> latest;
+		size_t pending;
+		// Id ranges with durable records.
+		std::vector<StoredRange> ranges;
+		// Objects being created from their records by other threads.
+		std::unordered_set<ObjectId> loading;
+		
+		std::mutex dirtyMutex;
+		// Objects changed since last Write, true for removed ones.
+		std::unordered_map<ObjectId, bool> dirty;
+	};
+}
+
+#endif
+
@@ -0,0 +1,89 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Batch.hpp"
+
+namespace rpc {
+	
+	Batch::Batch() : count(0) {
+		writer << (int32_t)0;
+	}
+	
+	int32_t Batch::BeginRecord() {
+		const int32_t begin = writer.GetBuffer().Size();
+		writer << (int32_t)0;
+		return begin;
+	}
+	
+	void Batch::EndRecord(int32_t begin) {
+		writer.Patch<int32_t>(begin, writer.GetBuffer().Size() - begin - 4);
+		++count;
+	}
+	
+	void Batch::Finish(networking::Buffer& frame) {
+		writer.Patch<int32_t>(0, count);
+		frame = std::move(writer.GetBuffer());
+		count = 0;
+		writer << (int32_t)0;
+	}
+	
+	
+	
+	BatchResponse::BatchResponse(networking::Buffer& frame) :
+		reader(frame), count(0), current(0) {
+		reader >> count;
+	}
+	
+	BatchResponse::RecordStatus BatchResponse::NextRecord(int32_t& recordEnd) {
+		const int32_t end = reader.GetBuffer().Size();
+		if(current >= count || reader.GetReadBytes()+4 > end)
+			return RECORD_END;
+		++current;
+		int32_t length = 0;
+		reader >> length;
+		if(length == -1)
+			return RECORD_FAILED;
+		if(length < 0 || length > end - reader.GetReadBytes()) {
+			current = count;
+			return RECORD_END;
+		}
+		recordEnd = reader.GetReadBytes() + length;
+		return RECORD_RETURNED;
+	}
+	
+	
+	
+	AutoBatch::AutoBatch(networking::Loop* loop,
+			std::function<void(networking::Buffer&)> send) :
+		loop(loop), state(new State{Batch(), std::move(send), false}) {
+	}
+	
+	void AutoBatch::Flush() {
+		Flush(*state);
+	}
+	
+	void AutoBatch::Flush(State& state) {
+		state.flushPending = false;
+		if(state.batch.Empty())
+			return;
+		networking::Buffer frame;
+		state.batch.Finish(frame);
+		state.send(frame);
+	}
+}
+
@@ -0,0 +1,170 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RPC_BATCH_HPP
+#define DORPC_RPC_BATCH_HPP
+
+#include <functional>
+#include <memory>
+#include <cinttypes>
+
+#include "../networking/Buffer.hpp"
+#include "../networking/Loop.hpp"
+#include "../serialization/serializator.hpp"
+#include "FunctionRegistry.hpp"
+#include "Function.hpp"
+
+namespace rpc {
+	/*
+	 * Builder of batch frame: int32 count of records followed by records of
+	 * int32 length and length bytes of single call (function id and
+	 * arguments). Methods of remote objects may be added too, with ObjectId
+	 * as first argument. Executed by FunctionRegistry::CallBatch, which
+	 * responds with the same layout, where each record of two-way call holds
+	 * returned value or has length -1 when call failed.
+	 */
+	class Batch {
+	public:
+		
+		Batch();
+		
+		template<typename Type, Type func, typename... Args>
+		inline bool Add(Args&&... args) {
+			const int32_t begin = BeginRecord();
+			if(CallStub<Type, func>::PrepareCall(writer,
+						std::forward<Args>(args)...) == false) {
+				writer.GetBuffer().Resize(begin);
+				return false;
+			}
+			EndRecord(begin);
+			return true;
+		}
+		
+		// One-way records have no record in response.
+		template<typename Type, Type func, typename... Args>
+		inline bool AddOneWay(Args&&... args) {
+			const int32_t begin = BeginRecord();
+			if(CallStub<Type, func>::PrepareOneWayCall(writer,
+						std::forward<Args>(args)...) == false) {
+				writer.GetBuffer().Resize(begin);
+				return false;
+			}
+			EndRecord(begin);
+			return true;
+		}
+		
+		inline int32_t Count() const { return count; }
+		inline bool Empty() const { return count == 0; }
+		
+		// Moves finished frame to frame and resets the batch.
+		void Finish(networking::Buffer& frame);
+		
+	private:
+		
+		int32_t BeginRecord();
+		void EndRecord(int32_t begin);
+		
+		serialization::Writer writer;
+		int32_t count;
+	};
+	
+	// Reads response to batch frame, records are in order of calls.
+	class BatchResponse {
+	public:
+		
+		enum RecordStatus {
+			RECORD_RETURNED,
+			// Call failed on remote side, value is not modified and
+			// following records can still be read.
+			RECORD_FAILED,
+			// No more records, or the frame is malformed.
+			RECORD_END
+		};
+		
+		BatchResponse(networking::Buffer& frame);
+		
+		inline int32_t Count() const { return count; }
+		
+		// Reads returned value of next record.
+		template<typename T>
+		inline RecordStatus Next(T& value) {
+			int32_t recordEnd;
+			const RecordStatus status = NextRecord(recordEnd);
+			if(status != RECORD_RETURNED)
+				return status;
+			reader >> value;
+			reader.SetReadBytes(recordEnd);
+			return RECORD_RETURNED;
+		}
+		
+	private:
+		
+		RecordStatus NextRecord(int32_t& recordEnd);
+		
+		serialization::Reader reader;
+		int32_t count;
+		int32_t current;
+	};
+	
+	/*
+	 * Collects calls made during one loop iteration into a single batch frame,
+	 * which is passed to send when the loop runs its posted tasks. Loop thread
+	 * only. Calls already made are still sent if AutoBatch is destroyed
+	 * before the flush.
+	 */
+	class AutoBatch {
+	public:
+		
+		AutoBatch(networking::Loop* loop,
+				std::function<void(networking::Buffer&)> send);
+		
+		template<typename Type, Type func, typename... Args>
+		inline bool Call(Args&&... args) {
+			if(state->batch.template Add<Type, func>(
+						std::forward<Args>(args)...) == false)
+				return false;
+			if(state->flushPending == false) {
+				state->flushPending = true;
+				std::shared_ptr<State> s = state;
+				loop->Post([s]() {
+						Flush(*s);
+					});
+			}
+			return true;
+		}
+		
+		// Sends collected calls immediately.
+		void Flush();
+		
+	private:
+		
+		struct State {
+			Batch batch;
+			std::function<void(networking::Buffer&)> send;
+			bool flushPending;
+		};
+		
+		static void Flush(State& state);
+		
+		networking::Loop* loop;
+		std::shared_ptr<State> state;
+	};
+}
+
+#endif
+
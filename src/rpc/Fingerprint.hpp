@@ -0,0 +1,165 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RPC_FINGERPRINT_HPP
+#define DORPC_RPC_FINGERPRINT_HPP
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <set>
+#include <map>
+#include <unordered_set>
+#include <unordered_map>
+#include <tuple>
+#include <type_traits>
+#include <cinttypes>
+
+#include "../networking/Buffer.hpp"
+
+namespace rpc {
+	
+	// FNV-1a
+	constexpr uint64_t HashString(const char* str,
+			uint64_t hash = 14695981039346656037ull) {
+		while(*str) {
+			hash ^= (uint8_t)*str;
+			hash *= 1099511628211ull;
+			++str;
+		}
+		return hash;
+	}
+	
+	constexpr uint64_t HashCombine(uint64_t a, uint64_t b) {
+		a ^= b + 0x9E3779B97F4A7C15ull + (a<<6) + (a>>2);
+		a ^= a >> 33;
+		a *= 0xFF51AFD7ED558CCDull;
+		a ^= a >> 33;
+		return a;
+	}
+	
+	template<typename... Ts>
+	constexpr uint64_t HashTypes(uint64_t seed);
+	
+	template<typename T>
+	constexpr bool dependent_false = false;
+	
+	/*
+	 * Fingerprint of type as seen by serialization - types with the same wire
+	 * format have the same fingerprint, e.g. std::vector<T> and std::set<T>.
+	 * Types with user defined serialization need explicit specialization
+	 * with stable name, e.g. HashString("my::Type").
+	 */
+	template<typename T, typename = void>
+	struct TypeFingerprint {
+		static_assert(dependent_false<T>,
+				"rpc::TypeFingerprint has to be specialized for this type");
+		static constexpr uint64_t Get() { return 0; }
+	};
+	
+	template<typename T>
+	struct TypeFingerprint<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+		static constexpr uint64_t Get() {
+			return HashCombine(HashString(std::is_floating_point_v<T> ? "float"
+						: std::is_signed_v<T> ? "int" : "uint"), sizeof(T));
+		}
+	};
+	
+	template<>
+	struct TypeFingerprint<void> {
+		static constexpr uint64_t Get() { return HashString("void"); }
+	};
+	
+	template<>
+	struct TypeFingerprint<std::string> {
+		static constexpr uint64_t Get() { return HashString("string"); }
+	};
+	
+	template<>
+	struct TypeFingerprint<std::string_view> : TypeFingerprint<std::string> {
+	};
+	
+	template<>
+	struct TypeFingerprint<const char*> : TypeFingerprint<std::string> {
+	};
+	
+	template<>
+	struct TypeFingerprint<std::vector<uint8_t>> : TypeFingerprint<std::string> {
+	};
+	
+	template<>
+	struct TypeFingerprint<std::vector<int8_t>> : TypeFingerprint<std::string> {
+	};
+	
+	template<>
+	struct TypeFingerprint<networking::Buffer> : TypeFingerprint<std::string> {
+	};
+	
+	template<typename T>
+	struct TypeFingerprint<std::vector<T>> {
+		static constexpr uint64_t Get() {
+			return HashTypes<T>(HashString("sequence"));
+		}
+	};
+	
+	template<typename T>
+	struct TypeFingerprint<std::set<T>> : TypeFingerprint<std::vector<T>> {
+	};
+	
+	template<typename T>
+	struct TypeFingerprint<std::unordered_set<T>>
+		: TypeFingerprint<std::vector<T>> {
+	};
+	
+	template<typename K, typename V>
+	struct TypeFingerprint<std::map<K, V>> {
+		static constexpr uint64_t Get() {
+			return HashTypes<K, V>(HashString("map"));
+		}
+	};
+	
+	template<typename K, typename V>
+	struct TypeFingerprint<std::unordered_map<K, V>>
+		: TypeFingerprint<std::map<K, V>> {
+	};
+	
+	template<typename... Args>
+	struct TypeFingerprint<std::tuple<Args...>> {
+		static constexpr uint64_t Get() {
+			return HashTypes<Args...>(HashString("tuple"));
+		}
+	};
+	
+	template<typename... Ts>
+	constexpr uint64_t HashTypes(uint64_t seed) {
+		((seed = HashCombine(seed,
+			TypeFingerprint<std::remove_cv_t<std::remove_reference_t<Ts>>>
+				::Get())), ...);
+		return seed;
+	}
+	
+	// Fingerprint of function signature, reference and const qualifiers of
+	// parameters are ignored, as they do not change wire format.
+	template<typename Ret, typename... Args>
+	constexpr uint64_t SignatureFingerprint() {
+		return HashTypes<Args...>(HashTypes<Ret>(HashString("function")));
+	}
+}
+
+#endif
+
@@ -20,9 +20,14 @@
 #define DORPC_RPC_FUNCTION_HPP
 
 #include <unordered_map>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <atomic>
 
 #include "FunctionBase.hpp"
 #include "FunctionRegistry.hpp"
+#include "Fingerprint.hpp"
 
 namespace rpc {
 	
@@ -32,13 +37,33 @@ namespace rpc {
 	template<typename Ret, typename... Args>
 	struct FunctionTraits<Ret(*)(Args...)> {
 		using tuple = std::tuple<Args...>;
+		// Storage for decoded arguments, see Function::Invoke.
+		using decayed_tuple = std::tuple<std::decay_t<Args>...>;
 		using ret = Ret;
 		using type = std::function<Ret(Args...)>;
-		inline static tuple MakeTuple(Args... args) {
-			return std::make_tuple(args...);
+		static constexpr uint64_t signature =
+			SignatureFingerprint<Ret, Args...>();
+		inline static std::tuple<const std::decay_t<Args>&...> MakeTuple(
+				const std::decay_t<Args>&... args) {
+			return {args...};
+		}
+		// Writes each argument converted to its parameter type, without
+		// copying arguments which already have that type.
+		template<typename... CallArgs>
+		inline static void WriteArgs(serialization::Writer& writer,
+				CallArgs&&... args) {
+			static_assert(sizeof...(CallArgs) == sizeof...(Args),
+					"Wrong number of arguments");
+			((writer << static_cast<const std::decay_t<Args>&>(args)), ...);
 		}
 	};
 	
+	// Decoded arguments are moved into by value and rvalue reference
+	// parameters, lvalue reference parameters bind to decoded storage.
+	template<typename Arg>
+	using ForwardedArg = std::conditional_t<std::is_lvalue_reference_v<Arg>,
+		  Arg, std::decay_t<Arg>&&>;
+	
 	template<typename Type, Type ptr>
 	class Function : public FunctionBase {
 	public:
@@ -52,45 +77,109 @@ namespace rpc {
 		}
 		
 		virtual ~Function() override {
+			Function* self = this;
+			instance.compare_exchange_strong(self, NULL);
 			FunctionRegistry::Remove(this);
 		}
 		
-		inline static void Register() {
-			FunctionRegistry::Add(new Function<Type, ptr>());
+		inline static void Register(const char* name = "") {
+			Function<Type, ptr>* function = new Function<Type, ptr>();
+			function->SetName(name);
+			function->SetFingerprint(HashString(name,
+						FunctionTraits<Type>::signature));
+			FunctionRegistry::Add(function);
+			instance.store(function, std::memory_order_release);
 		}
 		
 		inline static FunctionBase* Instance() {
-			static FunctionBase* instance =
-				FunctionRegistry::Singleton().GetByPtr(StaticGetPtr());
-			return instance;
+			return instance.load(std::memory_order_acquire);
 		}
 		
-		virtual void Execute(serialization::Reader& reader) override {
-			typename FunctionTraits<Type>::tuple args;
+		// Call stub, writes function id and arguments to writer without
+		// registry lookup. Returns false if function is not registered.
+		template<typename... Args>
+		inline static bool PrepareCall(serialization::Writer& writer,
+				Args&&... args) {
+			return WriteCall(writer, 0, std::forward<Args>(args)...);
+		}
+		
+		// Remote side executes the call without sending any response.
+		template<typename... Args>
+		inline static bool PrepareOneWayCall(serialization::Writer& writer,
+				Args&&... args) {
+			return WriteCall(writer, ONE_WAY_FLAG, std::forward<Args>(args)...);
+		}
+		
+		virtual bool Execute(serialization::Reader& reader) override {
+			typename FunctionTraits<Type>::decayed_tuple args;
 			reader >> args;
-			std::apply(ptr, args);
+			Invoke(args, std::make_index_sequence<
+					std::tuple_size_v<decltype(args)>>{});
+			return true;
 		}
 		
-		virtual void ExecuteWithReturn(serialization::Reader& reader,
+		virtual bool ExecuteWithReturn(serialization::Reader& reader,
 				serialization::Writer& writerRet) override {
-			typename FunctionTraits<Type>::tuple args;
+			typename FunctionTraits<Type>::decayed_tuple args;
 			reader >> args;
-			writerRet << std::apply(ptr, args);
+			if constexpr(std::is_void_v<typename FunctionTraits<Type>::ret>)
+				Invoke(args, std::make_index_sequence<
+						std::tuple_size_v<decltype(args)>>{});
+			else
+				writerRet << Invoke(args, std::make_index_sequence<
+						std::tuple_size_v<decltype(args)>>{});
+			return true;
+		}
+		
+		template<size_t... I>
+		inline static typename FunctionTraits<Type>::ret Invoke(
+				typename FunctionTraits<Type>::decayed_tuple& args,
+				std::index_sequence<I...>) {
+			using tuple = typename FunctionTraits<Type>::tuple;
+			return ptr(static_cast<ForwardedArg<std::tuple_element_t<I, tuple>>>(
+						std::get<I>(args))...);
 		}
 		
 	protected:
 		
 		Function() = default;
+		
+		template<typename... Args>
+		inline static bool WriteCall(serialization::Writer& writer,
+				uint32_t flags, Args&&... args) {
+			FunctionBase* function = Instance();
+			if(function == NULL)
+				return false;
+			writer << (function->GetId() | flags);
+			FunctionTraits<Type>::WriteArgs(writer, std::forward<Args>(args)...);
+			return true;
+		}
+		
+		inline static std::atomic<Function*> instance = NULL;
 	};
 	
 	template<typename Type, Type func>
-	inline void RegisterFunction() {
-		Function<Type, func>::Register();
+	inline void RegisterFunction(const char* name = "") {
+		Function<Type, func>::Register(name);
 	}
 }
 
+namespace rmi {
+	template<typename Type, Type ptr>
+	class Method;
+}
+
+namespace rpc {
+	// Call stub of free function or of remote object method (rmi::Method,
+	// which takes target ObjectId as first argument).
+	template<typename Type, Type func>
+	using CallStub = std::conditional_t<std::is_member_function_pointer_v<Type>,
+		  rmi::Method<Type, func>, Function<Type, func>>;
+}
+
 #define FUNCTION(__F) rpc::Function<decltype(__F), __F>::Instance()
-#define REGISTER_FUNCTION(__F) rpc::Function<decltype(&__F), __F>::Register()
+#define REGISTER_FUNCTION(__F) \
+	rpc::Function<decltype(&__F), __F>::Register(#__F)
 
 #endif
 
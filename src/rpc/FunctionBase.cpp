@@ -25,6 +25,7 @@ namespace rpc {
 	FunctionBase::FunctionBase() :
 		originalId(++FunctionBase_functionsCounter) {
 		id = originalId;
+		fingerprint = 0;
 	}
 }
 
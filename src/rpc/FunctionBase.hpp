@@ -23,6 +23,7 @@
 #include <functional>
 #include <tuple>
 #include <vector>
+#include <string>
 #include <cinttypes>
 #include <atomic>
 
@@ -33,23 +34,49 @@ namespace rpc {
 	class FunctionBase {
 	public:
 		
+		// Set in function id on the wire for calls which expect no response.
+		static constexpr uint32_t ONE_WAY_FLAG = 0x80000000u;
+		// Set in first word of stream frames, see StreamManager.
+		static constexpr uint32_t STREAM_FLAG = 0x40000000u;
+		
 		virtual ~FunctionBase() = default;
 		
 		virtual void* GetPtr() = 0;
 		
-		virtual void Execute(serialization::Reader& reader) = 0;
-		virtual void ExecuteWithReturn(serialization::Reader& reader,
+		// Return false when call target does not exist, e.g. remote object
+		// method called on object which is not present on this node.
+		virtual bool Execute(serialization::Reader& reader) = 0;
+		virtual bool ExecuteWithReturn(serialization::Reader& reader,
 				serialization::Writer& writerRet) = 0;
 		
+		// True for methods of remote objects, whose calls carry target
+		// ObjectId right after function id.
+		virtual bool HasTargetObject() const { return false; }
+		
 		inline uint32_t GetId() const { return id; }
 		inline uint32_t SetId(uint32_t id) { return this->id = id; }
 		
+		// Name used to synchronise function ids between nodes, empty for
+		// functions not exported by name.
+		inline const std::string& GetName() const { return name; }
+		inline void SetName(const std::string& name) { this->name = name; }
+		
+		// Hash of name and signature, see Fingerprint.hpp. Compared when
+		// tables are exchanged, so mismatching callers are rejected once per
+		// connection instead of decoding garbage.
+		inline uint64_t GetFingerprint() const { return fingerprint; }
+		inline void SetFingerprint(uint64_t fingerprint) {
+			this->fingerprint = fingerprint;
+		}
+		
 	protected:
 		
 		FunctionBase();
 		
 		uint32_t id;
 		const uint32_t originalId;
+		std::string name;
+		uint64_t fingerprint;
 	};
 }
 
@@ -16,61 +16,174 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
+#include "FunctionTranslation.hpp"
+
 #include "FunctionRegistry.hpp"
 
 namespace rpc {
 	
+	std::atomic<const DispatchTable*> FunctionRegistry::table = NULL;
+	
 	FunctionRegistry& FunctionRegistry::Singleton() {
 		static FunctionRegistry singleton;
 		return singleton;
 	}
 	
+	FunctionRegistry::~FunctionRegistry() {
+		retired.push_back(table.exchange(NULL));
+		for(const DispatchTable* t : retired) {
+			if(t) {
+				delete[] t->functions;
+				delete t;
+			}
+		}
+	}
+	
+	void FunctionRegistry::Publish(uint32_t id, FunctionBase* function) {
+		const DispatchTable* old = table.load(std::memory_order_relaxed);
+		uint32_t oldSize = old ? old->size : 0;
+		if(id < oldSize) {
+			old->functions[id].store(function, std::memory_order_release);
+			return;
+		}
+		if(function == NULL)
+			return;
+		DispatchTable* t = new DispatchTable;
+		t->size = std::max({oldSize*2, id+1, 64u});
+		t->functions = new std::atomic<FunctionBase*>[t->size];
+		for(uint32_t i=0; i<t->size; ++i)
+			t->functions[i].store(i < oldSize
+					? old->functions[i].load(std::memory_order_relaxed)
+					: NULL, std::memory_order_relaxed);
+		t->functions[id].store(function, std::memory_order_relaxed);
+		table.store(t, std::memory_order_release);
+		if(old)
+			retired.push_back(old);
+	}
+	
 	void FunctionRegistry::Remove(FunctionBase* function) {
-		Singleton().functions.erase(function->GetId());
-		Singleton().functionsByPtr.erase(function->GetPtr());
+		FunctionRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		if(GetById(function->GetId()) == function)
+			registry.Publish(function->GetId(), NULL);
+		auto it = registry.functionsByPtr.find(function->GetPtr());
+		if(it != registry.functionsByPtr.end() && it->second == function)
+			registry.functionsByPtr.erase(it);
+		auto it2 = registry.functionsByName.find(function->GetName());
+		if(it2 != registry.functionsByName.end() && it2->second == function)
+			registry.functionsByName.erase(it2);
 	}
 	
 	void FunctionRegistry::Add(FunctionBase* function) {
-		Singleton().functions[function->GetId()] = function;
-		Singleton().functionsByPtr[function->GetPtr()] = function;
+		FunctionRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.Publish(function->GetId(), function);
+		registry.functionsByPtr[function->GetPtr()] = function;
+		if(function->GetName().size())
+			registry.functionsByName[function->GetName()] = function;
 	}
 	
-	FunctionBase* FunctionRegistry::GetById(uint32_t id) {
-		auto it = Singleton().functions.find(id);
-		if(it != Singleton().functions.end())
+	FunctionBase* FunctionRegistry::GetByPtr(void* ptr) {
+		FunctionRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		auto it = registry.functionsByPtr.find(ptr);
+		if(it != registry.functionsByPtr.end())
 			return it->second;
 		return NULL;
 	}
 	
-	FunctionBase* FunctionRegistry::GetByPtr(void* ptr) {
-		auto it = Singleton().functionsByPtr.find(ptr);
-		if(it != Singleton().functionsByPtr.end())
+	FunctionBase* FunctionRegistry::GetByName(const std::string& name) {
+		FunctionRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		auto it = registry.functionsByName.find(name);
+		if(it != registry.functionsByName.end())
 			return it->second;
 		return NULL;
 	}
 	
+	void FunctionRegistry::WriteTable(serialization::Writer& writer) {
+		FunctionRegistry& registry = Singleton();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		writer << (int32_t)registry.functionsByName.size();
+		for(const auto& it : registry.functionsByName)
+			writer << it.first << it.second->GetId()
+				<< it.second->GetFingerprint();
+	}
+	
 	
 	bool FunctionRegistry::Call(serialization::Reader& args) {
 		uint32_t functionId;
 		args >> functionId;
-		FunctionBase* function = GetById(functionId);
-		if(function) {
-			function->Execute(args);
-			return true;
-		}
+		FunctionBase* function = GetById(
+				functionId & ~FunctionBase::ONE_WAY_FLAG);
+		if(function)
+			return function->Execute(args);
 		return false;
 	}
 	
 	bool FunctionRegistry::Call(serialization::Reader& args,
 				serialization::Writer& returned) {
-		uint32_t functionId;
+		return Succeeded(Dispatch(args, returned));
+	}
+	
+	FunctionRegistry::CallResult FunctionRegistry::Dispatch(
+			serialization::Reader& args, serialization::Writer& returned,
+			const FunctionTranslation* translation) {
+		uint32_t functionId = 0;
 		args >> functionId;
+		const bool oneWay = functionId & FunctionBase::ONE_WAY_FLAG;
+		functionId &= ~FunctionBase::ONE_WAY_FLAG;
+		if(translation)
+			functionId = translation->ToLocal(functionId);
 		FunctionBase* function = GetById(functionId);
-		if(function) {
-			function->ExecuteWithReturn(args, returned);
-			return true;
+		if(function == NULL)
+			return CALL_NOT_FOUND;
+		if(oneWay)
+			return function->Execute(args) ? CALL_ONE_WAY
+				: CALL_TARGET_NOT_FOUND;
+		return function->ExecuteWithReturn(args, returned) ? CALL_RETURNED
+			: CALL_TARGET_NOT_FOUND;
+	}
+	
+	int32_t FunctionRegistry::CallBatch(serialization::Reader& batch,
+			serialization::Writer& results,
+			const FunctionTranslation* translation) {
+		const int32_t end = batch.GetBuffer().Size();
+		int32_t count = 0, written = 0, executed = 0;
+		batch >> count;
+		const int32_t countOffset = results.GetBuffer().Size();
+		results << (int32_t)0;
+		for(int32_t i=0; i<count && batch.GetReadBytes()+4<=end; ++i) {
+			int32_t length = 0;
+			uint32_t functionId = 0;
+			batch >> length;
+			if(length < 4 || length > end - batch.GetReadBytes())
+				break;
+			const int32_t recordBegin = batch.GetReadBytes();
+			const int32_t recordEnd = recordBegin + length;
+			batch >> functionId;
+			batch.SetReadBytes(recordBegin);
+			if(functionId & FunctionBase::ONE_WAY_FLAG) {
+				if(Succeeded(Dispatch(batch, results, translation)))
+					++executed;
+			} else {
+				const int32_t lengthOffset = results.GetBuffer().Size();
+				results << (int32_t)-1;
+				if(Succeeded(Dispatch(batch, results, translation))) {
+					results.Patch<int32_t>(lengthOffset,
+							results.GetBuffer().Size() - lengthOffset - 4);
+					++executed;
+				} else {
+					results.GetBuffer().Resize(lengthOffset + 4);
+				}
+				++written;
+			}
+			batch.SetReadBytes(recordEnd);
 		}
-		return false;
+		results.Patch<int32_t>(countOffset, written);
+		return executed;
 	}
 }
 
@@ -23,35 +23,110 @@
 #include <functional>
 #include <vector>
 #include <cinttypes>
+#include <atomic>
+#include <mutex>
 
 #include "FunctionBase.hpp"
+#include "../networking/Endpoint.hpp"
 #include "../serialization/serializator.hpp"
 
 namespace rpc {
+	class FunctionTranslation;
+	
+	// Registered functions indexed by id. Slots are updated in place, the
+	// table is replaced only when it has to grow.
+	struct DispatchTable {
+		uint32_t size;
+		std::atomic<FunctionBase*>* functions;
+	};
+	
 	class FunctionRegistry {
 	public:
 		
 		static FunctionRegistry& Singleton();
 		
+		// Add and Remove update DispatchTable in place. Growing publishes
+		// table of twice the size, previous tables are retired but kept
+		// alive until exit, because dispatching threads may still read them.
+		// Their total size is bounded by size of the current table.
 		static void Add(FunctionBase* function);
 		static void Remove(FunctionBase* function);
-		static FunctionBase* GetById(uint32_t id);
+		
+		// Lock free, safe to call concurrently with Add and Remove.
+		inline static FunctionBase* GetById(uint32_t id) {
+			const DispatchTable* t = table.load(std::memory_order_acquire);
+			if(t && id < t->size)
+				return t->functions[id].load(std::memory_order_acquire);
+			return NULL;
+		}
 		static FunctionBase* GetByPtr(void* ptr);
+		static FunctionBase* GetByName(const std::string& name);
+		
+		// Writes (name, id, fingerprint) of all named functions, read by
+		// FunctionTranslation::ReadRemoteTable on the other side.
+		static void WriteTable(serialization::Writer& writer);
 		
 		static bool Call(serialization::Reader& args);
 		static bool Call(serialization::Reader& args,
 				serialization::Writer& returned);
 		
+		enum CallResult {
+			CALL_NOT_FOUND,
+			// One-way call, returned was not touched and no response should
+			// be sent.
+			CALL_ONE_WAY,
+			CALL_RETURNED,
+			// Function exists, but its target (remote object) is not present
+			// on this node.
+			CALL_TARGET_NOT_FOUND
+		};
+		inline static bool Succeeded(CallResult result) {
+			return result == CALL_ONE_WAY || result == CALL_RETURNED;
+		}
+		static CallResult Dispatch(serialization::Reader& args,
+				serialization::Writer& returned,
+				const FunctionTranslation* translation = NULL);
+		// Loop thread only, uses function translation of socket the call
+		// was received from.
+		inline static CallResult Dispatch(serialization::Reader& args,
+				serialization::Writer& returned,
+				const networking::Endpoint& origin) {
+			return Dispatch(args, returned, origin.GetFunctionTranslation());
+		}
+		
+		// Executes all call records of batch frame built by rpc::Batch and
+		// writes one response record per two-way call record to results.
+		// Returns number of executed calls. Optional translation remaps
+		// function ids.
+		static int32_t CallBatch(serialization::Reader& batch,
+				serialization::Writer& results,
+				const FunctionTranslation* translation = NULL);
+		inline static int32_t CallBatch(serialization::Reader& batch,
+				serialization::Writer& results,
+				const networking::Endpoint& origin) {
+			return CallBatch(batch, results, origin.GetFunctionTranslation());
+		}
+		
 		template<typename Func, Func func, typename... Args>
 		static bool PrepareFunctionCall(serialization::Writer& writer,
-				Args... args);
+				Args&&... args);
+		template<typename Func, Func func, typename... Args>
+		static bool PrepareOneWayFunctionCall(serialization::Writer& writer,
+				Args&&... args);
 		
 	private:
 		
 		FunctionRegistry() = default;
+		~FunctionRegistry();
+		
+		void Publish(uint32_t id, FunctionBase* function);
+		
+		static std::atomic<const DispatchTable*> table;
 		
-		std::unordered_map<uint32_t, FunctionBase*> functions;
+		std::mutex mutex;
+		std::vector<const DispatchTable*> retired;
 		std::unordered_map<void*, FunctionBase*> functionsByPtr;
+		std::unordered_map<std::string, FunctionBase*> functionsByName;
 	};
 }
 
@@ -60,14 +135,16 @@ namespace rpc {
 namespace rpc {
 	template<typename Func, Func func, typename... Args>
 	bool FunctionRegistry::PrepareFunctionCall(serialization::Writer& writer,
-			Args... args) {
-		FunctionBase* function = rpc::Function<Func, func>::Instance();
-		if(function) {
-			writer << function->GetId();
-			writer << rpc::FunctionTraits<Func>::MakeTuple(args...);
-			return true;
-		}
-		return false;
+			Args&&... args) {
+		return rpc::Function<Func, func>::PrepareCall(writer,
+				std::forward<Args>(args)...);
+	}
+	
+	template<typename Func, Func func, typename... Args>
+	bool FunctionRegistry::PrepareOneWayFunctionCall(
+			serialization::Writer& writer, Args&&... args) {
+		return rpc::Function<Func, func>::PrepareOneWayCall(writer,
+				std::forward<Args>(args)...);
 	}
 }
 
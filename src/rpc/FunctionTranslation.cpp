@@ -0,0 +1,77 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "FunctionRegistry.hpp"
+
+#include "FunctionTranslation.hpp"
+
+namespace rpc {
+	
+	FunctionTranslation::FunctionTranslation() : synchronized(false) {
+	}
+	
+	uint32_t FunctionTranslation::ReadRemoteTable(
+			serialization::Reader& reader) {
+		remoteToLocal.clear();
+		synchronized = true;
+		uint32_t missing = 0;
+		int32_t count = 0;
+		reader >> count;
+		for(int32_t i=0; i<count; ++i) {
+			if(reader.GetReadBytes() >= reader.GetBuffer().Size())
+				break;
+			std::string name;
+			uint32_t remoteId = 0;
+			uint64_t fingerprint = 0;
+			reader >> name >> remoteId >> fingerprint;
+			FunctionBase* function = FunctionRegistry::GetByName(name);
+			if(function == NULL || function->GetFingerprint() != fingerprint
+					|| remoteId == 0
+					|| remoteId >= MAX_REMOTE_ID) {
+				++missing;
+				continue;
+			}
+			if(remoteId >= remoteToLocal.size())
+				remoteToLocal.resize(remoteId+1, 0);
+			remoteToLocal[remoteId] = function->GetId();
+		}
+		return missing;
+	}
+	
+	bool FunctionTranslation::Call(serialization::Reader& args) {
+		uint32_t functionId;
+		args >> functionId;
+		FunctionBase* function = FunctionRegistry::GetById(
+				ToLocal(functionId & ~FunctionBase::ONE_WAY_FLAG));
+		if(function)
+			return function->Execute(args);
+		return false;
+	}
+	
+	bool FunctionTranslation::Call(serialization::Reader& args,
+				serialization::Writer& returned) {
+		return FunctionRegistry::Succeeded(
+				FunctionRegistry::Dispatch(args, returned, this));
+	}
+	
+	int32_t FunctionTranslation::CallBatch(serialization::Reader& batch,
+				serialization::Writer& results) {
+		return FunctionRegistry::CallBatch(batch, results, this);
+	}
+}
+
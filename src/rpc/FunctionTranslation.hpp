@@ -0,0 +1,77 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RPC_FUNCTION_TRANSLATION_HPP
+#define DORPC_RPC_FUNCTION_TRANSLATION_HPP
+
+#include <vector>
+#include <cinttypes>
+
+#include "FunctionBase.hpp"
+#include "../serialization/serializator.hpp"
+
+namespace rpc {
+	/*
+	 * Per connection translation from function ids of remote node to local
+	 * ids. Both sides send FunctionRegistry::WriteTable once after connecting
+	 * and pass received table to ReadRemoteTable. Calls keep sending their
+	 * own 4 byte ids, which receiver remaps with single array load. Until
+	 * remote table is read ids are used as is.
+	 *
+	 * networking::Context::EnableFunctionTranslation performs the exchange
+	 * on every socket, received calls are then dispatched with
+	 * FunctionRegistry::Dispatch(args, returned, endpoint).
+	 */
+	class FunctionTranslation {
+	public:
+		
+		// Larger remote ids are rejected to bound size of translation array.
+		static constexpr uint32_t MAX_REMOTE_ID = 1u << 20;
+		
+		FunctionTranslation();
+		
+		// Returns number of remote functions without local counterpart or with
+		// different signature fingerprint. Those ids are not callable.
+		uint32_t ReadRemoteTable(serialization::Reader& reader);
+		
+		inline uint32_t ToLocal(uint32_t remoteId) const {
+			if(synchronized == false)
+				return remoteId;
+			if(remoteId < remoteToLocal.size())
+				return remoteToLocal[remoteId];
+			return 0;
+		}
+		
+		inline bool IsSynchronized() const { return synchronized; }
+		
+		// Same as FunctionRegistry::Call, but with translated function id.
+		bool Call(serialization::Reader& args);
+		bool Call(serialization::Reader& args,
+				serialization::Writer& returned);
+		int32_t CallBatch(serialization::Reader& batch,
+				serialization::Writer& results);
+		
+	private:
+		
+		std::vector<uint32_t> remoteToLocal;
+		bool synchronized;
+	};
+}
+
+#endif
+
@@ -0,0 +1,251 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <mutex>
+
+#include "FunctionBase.hpp"
+
+#include "Stream.hpp"
+
+namespace rpc {
+	
+	using StreamHandler =
+		std::function<void(IncomingStream*, serialization::Reader&)>;
+	
+	static std::mutex& HandlersMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+	
+	static std::unordered_map<std::string, StreamHandler>& Handlers() {
+		static std::unordered_map<std::string, StreamHandler> handlers;
+		return handlers;
+	}
+	
+	StreamManager::StreamManager(
+			std::function<void(networking::Buffer&)> send) :
+		send(send), delivering(NULL), streamsCounter(0) {
+	}
+	
+	StreamManager::~StreamManager() {
+		for(auto& it : incoming)
+			delete it.second;
+		for(auto& it : outgoing)
+			delete it.second;
+	}
+	
+	void StreamManager::RegisterHandler(const std::string& name,
+			StreamHandler handler) {
+		std::lock_guard<std::mutex> lock(HandlersMutex());
+		Handlers()[name] = handler;
+	}
+	
+	bool StreamManager::IsStreamFrame(networking::Buffer& frame) {
+		return frame.Size() >= 8 && (frame.Data()[3] & 0xC0) == 0x40;
+	}
+	
+	bool StreamManager::OnFrame(networking::Buffer& frame) {
+		if(IsStreamFrame(frame) == false)
+			return false;
+		serialization::Reader reader(frame);
+		uint32_t kind = 0, id = 0;
+		reader >> kind >> id;
+		kind &= ~FunctionBase::STREAM_FLAG;
+		
+		if(kind == OPEN) {
+			std::string name;
+			reader >> name;
+			StreamHandler handler;
+			{
+				std::lock_guard<std::mutex> lock(HandlersMutex());
+				auto it = Handlers().find(name);
+				if(it != Handlers().end())
+					handler = it->second;
+			}
+			if(!handler || incoming.count(id)
+					|| incoming.size() >= MAX_INCOMING_STREAMS) {
+				SendControl(CANCEL, id, 0);
+				return true;
+			}
+			IncomingStream* stream = new IncomingStream{id, NULL, NULL, NULL,
+				NULL, false, INITIAL_WINDOW, 0};
+			incoming[id] = stream;
+			handler(stream, reader);
+		} else if(kind == DATA) {
+			auto it = incoming.find(id);
+			if(it == incoming.end())
+				return true;
+			IncomingStream* stream = it->second;
+			const int32_t size = frame.Size() - 8;
+			stream->window -= size;
+			if(stream->window < 0) {
+				// Sender ignored flow control.
+				SendControl(CANCEL, id, 0);
+				CloseIncoming(id, true);
+				return true;
+			}
+			if(stream->onChunk) {
+				delivering = stream;
+				stream->onChunk(frame.Data()+8, size);
+				delivering = NULL;
+				// Cancelled from inside of onChunk.
+				if(incoming.count(id) == 0) {
+					delete stream;
+					return true;
+				}
+			}
+			if(stream->manualCredit == false)
+				Consume(id, size);
+		} else if(kind == END || kind == RESET) {
+			CloseIncoming(id, kind == RESET);
+		} else if(kind == CREDIT) {
+			int32_t credits = 0;
+			reader >> credits;
+			auto it = outgoing.find(id);
+			if(it == outgoing.end() || credits <= 0)
+				return true;
+			it->second->credits += credits;
+			if(it->second->onWritable)
+				it->second->onWritable();
+		} else if(kind == CANCEL) {
+			auto it = outgoing.find(id);
+			if(it == outgoing.end())
+				return true;
+			OutgoingStream* stream = it->second;
+			outgoing.erase(it);
+			if(stream->onCancel)
+				stream->onCancel();
+			delete stream;
+		}
+		return true;
+	}
+	
+	uint32_t StreamManager::Open(const std::string& name,
+			const networking::Buffer* metadata) {
+		const uint32_t id = ++streamsCounter;
+		outgoing[id] = new OutgoingStream{id, INITIAL_WINDOW, NULL, NULL};
+		serialization::Writer writer;
+		writer << (FunctionBase::STREAM_FLAG | OPEN) << id << name;
+		if(metadata)
+			writer << *metadata;
+		send(writer.GetBuffer());
+		return id;
+	}
+	
+	int64_t StreamManager::Write(uint32_t stream, const void* data,
+			int64_t size) {
+		auto it = outgoing.find(stream);
+		if(it == outgoing.end())
+			return -1;
+		const int64_t accepted = std::min(size, it->second->credits);
+		it->second->credits -= accepted;
+		for(int64_t offset=0; offset<accepted; offset+=MAX_CHUNK) {
+			const int32_t chunk = std::min<int64_t>(accepted-offset, MAX_CHUNK);
+			serialization::Writer writer;
+			writer.GetBuffer().Reserve(chunk + 8);
+			writer << (FunctionBase::STREAM_FLAG | DATA) << stream;
+			writer.GetBuffer().Write((const uint8_t*)data + offset, chunk);
+			send(writer.GetBuffer());
+		}
+		return accepted;
+	}
+	
+	void StreamManager::SetCallbacks(uint32_t stream,
+			std::function<void()> onWritable, std::function<void()> onCancel) {
+		auto it = outgoing.find(stream);
+		if(it != outgoing.end()) {
+			it->second->onWritable = onWritable;
+			it->second->onCancel = onCancel;
+		}
+	}
+	
+	int64_t StreamManager::GetCredits(uint32_t stream) const {
+		auto it = outgoing.find(stream);
+		if(it == outgoing.end())
+			return -1;
+		return it->second->credits;
+	}
+	
+	void StreamManager::End(uint32_t stream) {
+		auto it = outgoing.find(stream);
+		if(it == outgoing.end())
+			return;
+		delete it->second;
+		outgoing.erase(it);
+		SendControl(END, stream, 0);
+	}
+	
+	void StreamManager::Reset(uint32_t stream) {
+		auto it = outgoing.find(stream);
+		if(it == outgoing.end())
+			return;
+		delete it->second;
+		outgoing.erase(it);
+		SendControl(RESET, stream, 0);
+	}
+	
+	void StreamManager::Consume(uint32_t stream, int64_t bytes) {
+		auto it = incoming.find(stream);
+		if(it == incoming.end())
+			return;
+		IncomingStream* s = it->second;
+		s->consumed += bytes;
+		// Credits are returned in batches to limit number of control frames.
+		if(s->consumed >= INITIAL_WINDOW/4) {
+			s->window += s->consumed;
+			SendControl(CREDIT, stream, s->consumed);
+			s->consumed = 0;
+		}
+	}
+	
+	void StreamManager::Cancel(uint32_t stream) {
+		auto it = incoming.find(stream);
+		if(it == incoming.end())
+			return;
+		if(it->second != delivering)
+			delete it->second;
+		incoming.erase(it);
+		SendControl(CANCEL, stream, 0);
+	}
+	
+	void StreamManager::SendControl(FrameKind kind, uint32_t stream,
+			int32_t value) {
+		serialization::Writer writer;
+		writer << (FunctionBase::STREAM_FLAG | kind) << stream;
+		if(kind == CREDIT)
+			writer << value;
+		send(writer.GetBuffer());
+	}
+	
+	void StreamManager::CloseIncoming(uint32_t stream, bool reset) {
+		auto it = incoming.find(stream);
+		if(it == incoming.end())
+			return;
+		IncomingStream* s = it->second;
+		incoming.erase(it);
+		if(reset) {
+			if(s->onReset)
+				s->onReset();
+		} else if(s->onEnd) {
+			s->onEnd();
+		}
+		delete s;
+	}
+}
+
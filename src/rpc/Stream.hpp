@@ -0,0 +1,130 @@
+/*
+ *  This file is part of DORPC. Please see README for details.
+ *  Copyright (C) 2021-2022 Marek Zalewski aka Drwalin
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DORPC_RPC_STREAM_HPP
+#define DORPC_RPC_STREAM_HPP
+
+#include <functional>
+#include <unordered_map>
+#include <string>
+#include <cinttypes>
+
+#include "../networking/Buffer.hpp"
+#include "../serialization/serializator.hpp"
+
+namespace rpc {
+	struct IncomingStream {
+		uint32_t id;
+		void* userData;
+		// Set by handler passed to StreamManager::RegisterHandler.
+		std::function<void(const uint8_t*, int32_t)> onChunk;
+		std::function<void()> onEnd;
+		std::function<void()> onReset;
+		// When true, credits are returned only by StreamManager::Consume,
+		// otherwise as soon as onChunk returns.
+		bool manualCredit;
+		// Bytes sender is still allowed to send.
+		int64_t window;
+		// Consumed bytes not yet returned to sender as credit.
+		int64_t consumed;
+	};
+	
+	struct OutgoingStream {
+		uint32_t id;
+		int64_t credits;
+		std::function<void()> onWritable;
+		std::function<void()> onCancel;
+	};
+	
+	/*
+	 * Per connection streams of chunks with credit based flow control. Each
+	 * stream is unidirectional, receiver initially grants INITIAL_WINDOW
+	 * bytes and returns credits as chunks are consumed, so memory used by a
+	 * stream is bounded regardless of its total size. Frames start with
+	 * FunctionBase::STREAM_FLAG | kind followed by stream id, so they never
+	 * collide with call frames. Not thread safe, use from connection's loop
+	 * thread.
+	 */
+	class StreamManager {
+	public:
+		
+		static constexpr int64_t INITIAL_WINDOW = 256*1024;
+		static constexpr int32_t MAX_CHUNK = 64*1024;
+		// Further remote OPENs are cancelled.
+		static constexpr size_t MAX_INCOMING_STREAMS = 1024;
+		
+		enum FrameKind {
+			// Sender to receiver.
+			OPEN = 1,
+			DATA = 2,
+			END = 3,
+			RESET = 4,
+			// Receiver to sender.
+			CREDIT = 5,
+			CANCEL = 6
+		};
+		
+		StreamManager(std::function<void(networking::Buffer&)> send);
+		~StreamManager();
+		
+		// Handler is called when remote side opens stream with given name,
+		// it should set callbacks of the stream. Metadata reader holds bytes
+		// passed to Open.
+		static void RegisterHandler(const std::string& name,
+				std::function<void(IncomingStream*,
+					serialization::Reader&)> handler);
+		
+		static bool IsStreamFrame(networking::Buffer& frame);
+		// Returns false if frame is not a stream frame.
+		bool OnFrame(networking::Buffer& frame);
+		
+		uint32_t Open(const std::string& name,
+				const networking::Buffer* metadata = NULL);
+		// Returns number of accepted bytes, limited by available credits, or
+		// -1 if stream does not exist or was cancelled by receiver.
+		int64_t Write(uint32_t stream, const void* data, int64_t size);
+		// onWritable is called when more credits arrive, onCancel when
+		// receiver cancels the stream.
+		void SetCallbacks(uint32_t stream, std::function<void()> onWritable,
+				std::function<void()> onCancel);
+		int64_t GetCredits(uint32_t stream) const;
+		void End(uint32_t stream);
+		void Reset(uint32_t stream);
+		
+		// Returns credits for bytes consumed by stream with manualCredit.
+		void Consume(uint32_t stream, int64_t bytes);
+		// Stops incoming stream, sender is notified. May be called from
+		// callbacks of the stream.
+		void Cancel(uint32_t stream);
+		
+	private:
+		
+		void SendControl(FrameKind kind, uint32_t stream, int32_t value);
+		void CloseIncoming(uint32_t stream, bool reset);
+		
+		std::function<void(networking::Buffer&)> send;
+		std::unordered_map<uint32_t, IncomingStream*> incoming;
+		std::unordered_map<uint32_t, OutgoingStream*> outgoing;
+		// Stream whose onChunk is running, freed by OnFrame after it returns.
+		IncomingStream* delivering;
+		uint32_t streamsCounter;
+	};
+}
+
+#endif
+
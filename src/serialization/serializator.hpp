@@ -169,6 +169,20 @@ namespace serialization {
 			return *this;
 		}
 		
+		// Overwrites value previously written at offset, used to fill length
+		// placeholders.
+		template<typename T>
+		inline void Patch(int32_t offset, T v) {
+			union {
+				T v2;
+				typename UINT<sizeof(T)>::type _v;
+			};
+			v2 = v;
+			uint8_t* data = buffer.Data() + offset;
+			for(size_t i=0; i<sizeof(T); ++i)
+				data[i] = (_v>>(i*8))&0xFF;
+		}
+		
 	private:
 		
 		template<typename T>
@@ -196,6 +210,7 @@ namespace serialization {
 		
 		inline networking::Buffer& GetBuffer() { return buffer; }
 		inline int32_t GetReadBytes() { return read; }
+		inline void SetReadBytes(int32_t read) { this->read = read; }
 		
 		inline Reader(networking::Buffer& buffer) : buffer(buffer), read(0) {
 		}
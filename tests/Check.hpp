@@ -0,0 +1,22 @@
+#ifndef DORPC_TESTS_CHECK_HPP
+#define DORPC_TESTS_CHECK_HPP
+
+#include <cstdio>
+
+// Numbered checks of one test program, Finish returns its exit code.
+
+inline int valid=0, total=0;
+
+inline void Check(int testId, bool result) {
+	printf(" test %i ... %s\n", testId, result?"OK":"FAILED");
+	if(result)
+		++valid;
+	++total;
+}
+
+inline int Finish() {
+	printf(" tests %i/%i ... %s\n", valid, total, valid==total?"OK":"FAILED");
+	return valid == total ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include "Check.hpp"
+
+const char* path = "/tmp/dorpc_broadcast_test.sock";
+const int connections = 4;
+
+networking::Loop* loop = NULL;
+networking::Context* context = NULL;
+std::set<networking::Socket*> serverSockets, clientSockets;
+std::set<networking::Socket*> receivers;
+int opened = 0, received = 0;
+
+void SendText(int stage, const char* text) {
+	networking::Buffer buffer;
+	buffer.Write(text, strlen(text)+1);
+	if(stage == 1) {
+		loop->Broadcast(buffer);
+	} else if(stage == 2) {
+		context->Broadcast(buffer);
+	} else if(stage == 3) {
+		// Only two server sockets are targeted, so only their client ends
+		// receive the message.
+		std::vector<uint64_t> handles;
+		for(networking::Socket* socket : serverSockets)
+			if(handles.size() < 2)
+				handles.push_back(socket->handle);
+		context->Multicast(handles, buffer);
+	} else {
+		std::vector<std::pair<networking::Context*, uint64_t>> targets;
+		for(networking::Socket* socket : clientSockets)
+			if(targets.size() < 2)
+				targets.emplace_back(context, socket->handle);
+		loop->Multicast(targets, buffer);
+	}
+}
+
+int main() {
+	loop = networking::Loop::Make();
+	context = networking::Context::Make(loop, [=](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				if(isClient)
+					clientSockets.insert(socket);
+				else
+					serverSockets.insert(socket);
+				if(++opened == connections*2)
+					SendText(1, "loop broadcast");
+			},
+			[=](networking::Buffer& buffer, networking::Socket* socket){
+				const char* text = (const char*)buffer.Data();
+				receivers.insert(socket);
+				++received;
+				if(strcmp(text, "loop broadcast") == 0) {
+					if(received < connections*2)
+						return;
+					Check(1, receivers.size() == connections*2);
+					received = 0;
+					receivers.clear();
+					SendText(2, "context broadcast");
+				} else if(strcmp(text, "context broadcast") == 0) {
+					if(received < connections*2)
+						return;
+					Check(2, receivers.size() == connections*2);
+					received = 0;
+					receivers.clear();
+					SendText(3, "multicast");
+				} else if(strcmp(text, "multicast") == 0) {
+					if(received < 2)
+						return;
+					bool clients = true;
+					for(networking::Socket* s : receivers)
+						if(clientSockets.count(s) == 0)
+							clients = false;
+					Check(3, receivers.size() == 2 && clients);
+					received = 0;
+					receivers.clear();
+					SendText(4, "loop multicast");
+				} else if(strcmp(text, "loop multicast") == 0) {
+					if(received < 2)
+						return;
+					bool servers = true;
+					for(networking::Socket* s : receivers)
+						if(serverSockets.count(s) == 0)
+							servers = false;
+					Check(4, receivers.size() == 2 && servers);
+					exit(Finish());
+				} else {
+					Check(total+1, false);
+					exit(Finish());
+				}
+			}, NULL, NULL, NULL, NULL);
+	
+	if(context->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	for(int i=0; i<connections; ++i)
+		context->InternalConnectUnix(path);
+	loop->Run();
+	return 1;
+}
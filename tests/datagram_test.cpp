@@ -0,0 +1,73 @@
+#include <networking/Loop.hpp>
+#include <networking/DatagramContext.hpp>
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+#include "Check.hpp"
+
+const int messages = 16;
+
+int received = 0;
+networking::Loop* loop = NULL;
+
+void Start(int testId, const char* key, const char* cert, const char* ca);
+
+void OnReceive(int testId, networking::Buffer& buffer,
+		networking::DatagramContext* context, int peerId) {
+	std::string_view v((char*)buffer.Data(), buffer.Size()-1);
+	if(v.starts_with("Hello ") == false || v.ends_with(" over udp") == false) {
+		Check(testId, false);
+		exit(Finish());
+	}
+	++received;
+	if(received != messages)
+		return;
+	Check(testId, true);
+	received = 0;
+	if(testId == 1) {
+		// Peer first seen by receiving is dropped with its address.
+		context->RemovePeer(peerId);
+		Check(2, context->peerCount == 0 && context->peerIds->empty()
+				&& (*context->peers)[peerId] == NULL);
+		Start(3, "cert/user.key", "cert/user.crt", "cert/rootca.crt");
+	}
+	else
+		exit(Finish());
+}
+
+// All messages are sent before the first datagram leaves, with DTLS they are
+// queued until the handshake and cookie exchange finish.
+void Start(int testId, const char* key, const char* cert, const char* ca) {
+	networking::DatagramContext* server = networking::DatagramContext::Make(
+			loop, "127.0.0.1", 0, [=](networking::Buffer& buffer,
+				networking::DatagramContext* context, int peerId) {
+				OnReceive(testId, buffer, context, peerId);
+			}, key, cert, ca, NULL);
+	networking::DatagramContext* client = networking::DatagramContext::Make(
+			loop, "127.0.0.1", 0, [](networking::Buffer& buffer,
+				networking::DatagramContext* context, int peerId) {
+			}, key, cert, ca, NULL);
+	if(server == NULL || client == NULL) {
+		Check(testId, false);
+		exit(Finish());
+	}
+	int peerId = client->AddPeer("127.0.0.1",
+			us_udp_socket_bound_port(server->socket));
+	for(int i=0; i<messages; ++i) {
+		networking::Buffer buffer;
+		char str[1024];
+		sprintf(str, "Hello %i over udp", i);
+		buffer.Write(str, strlen(str)+1);
+		client->Send(peerId, buffer);
+	}
+}
+
+int main() {
+	loop = networking::Loop::Make();
+	Start(1, NULL, NULL, NULL);
+	loop->Run();
+	return 1;
+}
@@ -9,6 +9,8 @@ std::ostream& operator<<(std::ostream& s, networking::Buffer& buffer);
 
 #include <rpc/FunctionRegistry.hpp>
 #include <rpc/Function.hpp>
+#include <rpc/FunctionTranslation.hpp>
+#include <rpc/Batch.hpp>
 
 template<typename T>
 std::ostream& operator<<(std::ostream& s, std::vector<T> v) {
@@ -68,7 +70,7 @@ int valid=0, invalid=0, total=0;
 template<typename Type, Type func, typename Ret, typename... Args>
 Ret Call__(Args... args) {
 	serialization::Writer preparedArgs, returned;
-	if(rpc::FunctionRegistry::PrepareFunctionCall<Type, func, Args...>(
+	if(rpc::FunctionRegistry::PrepareFunctionCall<Type, func>(
 				preparedArgs, args...) == false)
 		return Ret();
 	serialization::Reader argsReader(preparedArgs.GetBuffer());
@@ -115,9 +117,25 @@ std::string functionB(std::string a, std::vector<uint32_t> b,
 	return a;
 }
 
+std::string functionC(const std::string& a, std::vector<std::string> b,
+		int32_t& c) {
+	std::string ret = a;
+	for(std::string& s : b)
+		ret += std::move(s);
+	c += ret.size();
+	return ret + std::to_string(c);
+}
+
+int notified = 0;
+void functionD(int32_t value) {
+	notified += value;
+}
+
 int main() {
 	REGISTER_FUNCTION(functionA);
 	REGISTER_FUNCTION(functionB);
+	REGISTER_FUNCTION(functionC);
+	REGISTER_FUNCTION(functionD);
 	
 	Call<decltype(&functionA), functionA, int32_t, float, long long>(1, 'a', 'b', 'c');
 	Call<decltype(&functionA), functionA, int32_t, float, long long>(2, 'd', 'e', 'f');
@@ -128,7 +146,157 @@ int main() {
 	Call<decltype(&functionB), functionB, std::string, std::vector<uint32_t>, std::vector<std::string>>(7, "C_:", {1, 2, 0}, {"__4", "__5", "_6"});
 	Call<decltype(&functionB), functionB, std::string, std::vector<uint32_t>, std::vector<std::string>>(8, "++:", {1, 2, 0}, {"_9", "_10", "_11"});
 	
+	int32_t c1 = 3, c2 = 3;
+	Call<decltype(&functionC), functionC, std::string, std::vector<std::string>, int32_t&>(9, "x:", {"a", "bb"}, c1);
+	Call<decltype(&functionC), functionC, std::string, std::vector<std::string>, int32_t&>(10, "", {}, c2);
+	
+	
+	
+	{
+		// Remote node assigned different ids to the same functions.
+		serialization::Writer table;
+		table << (int32_t)3;
+		table << std::string("functionA") << (uint32_t)1000
+			<< FUNCTION(&functionA)->GetFingerprint();
+		// Same name, different signature.
+		table << std::string("functionB") << (uint32_t)7
+			<< rpc::HashString("functionB",
+					rpc::SignatureFingerprint<std::string, std::string>());
+		table << std::string("functionC") << (uint32_t)8 << (uint64_t)0;
+		serialization::Reader tableReader(table.GetBuffer());
+		rpc::FunctionTranslation translation;
+		uint32_t missing = translation.ReadRemoteTable(tableReader);
+		
+		serialization::Writer call, returned;
+		call << (uint32_t)1000 << (int32_t)3 << (float)2.0f << (long long)5;
+		serialization::Reader callReader(call.GetBuffer());
+		int r = 0;
+		if(translation.Call(callReader, returned)) {
+			serialization::Reader retReader(returned.GetBuffer());
+			retReader >> r;
+		}
+		bool result = missing == 2 && r == functionA(3, 2.0f, 5)
+			&& translation.ToLocal(7) == 0
+			&& translation.ToLocal(8) == 0;
+		printf(" test %i ... %s\n", 11, result?"OK":"FAILED");
+		if(result)
+			++valid;
+		else
+			++invalid;
+		++total;
+	}
 	
+	{
+		constexpr bool result =
+			rpc::SignatureFingerprint<int, int32_t>()
+				!= rpc::SignatureFingerprint<int, int64_t>()
+			&& rpc::SignatureFingerprint<void, const std::string&>()
+				== rpc::SignatureFingerprint<void, std::string>()
+			&& rpc::SignatureFingerprint<void, std::vector<int>>()
+				!= rpc::SignatureFingerprint<void, std::vector<float>>();
+		printf(" test %i ... %s\n", 12, result?"OK":"FAILED");
+		if(result)
+			++valid;
+		else
+			++invalid;
+		++total;
+	}
+	
+	{
+		rpc::Batch batch;
+		for(int32_t i=0; i<100; ++i)
+			batch.Add<decltype(&functionA), functionA>(i, 0.5f, 7ll);
+		batch.Add<decltype(&functionB), functionB>("B:",
+				std::vector<uint32_t>{0, 1}, std::vector<std::string>{"x", "y"});
+		networking::Buffer frame;
+		batch.Finish(frame);
+		
+		serialization::Reader batchReader(frame);
+		serialization::Writer results;
+		int32_t executed = rpc::FunctionRegistry::CallBatch(batchReader,
+				results);
+		
+		rpc::BatchResponse response(results.GetBuffer());
+		bool result = executed == 101 && response.Count() == 101
+			&& batch.Empty();
+		for(int32_t i=0; i<100; ++i) {
+			int r = -1;
+			result = result && response.Next(r)
+				== rpc::BatchResponse::RECORD_RETURNED
+				&& r == functionA(i, 0.5f, 7ll);
+		}
+		std::string rb;
+		result = result && response.Next(rb)
+			== rpc::BatchResponse::RECORD_RETURNED && rb == "B:..x..y";
+		printf(" test %i ... %s\n", 13, result?"OK":"FAILED");
+		if(result)
+			++valid;
+		else
+			++invalid;
+		++total;
+	}
+	
+	{
+		serialization::Writer oneWay, twoWay, returned1, returned2;
+		rpc::FunctionRegistry::PrepareOneWayFunctionCall<decltype(&functionD),
+			functionD>(oneWay, 5);
+		rpc::FunctionRegistry::PrepareFunctionCall<decltype(&functionD),
+			functionD>(twoWay, 7);
+		serialization::Reader oneWayReader(oneWay.GetBuffer());
+		serialization::Reader twoWayReader(twoWay.GetBuffer());
+		bool result = rpc::FunctionRegistry::Dispatch(oneWayReader, returned1)
+			== rpc::FunctionRegistry::CALL_ONE_WAY
+			&& returned1.GetBuffer().Capacity() == 0
+			&& rpc::FunctionRegistry::Dispatch(twoWayReader, returned2)
+			== rpc::FunctionRegistry::CALL_RETURNED
+			&& returned2.GetBuffer().Size() == 0
+			&& notified == 12;
+		
+		rpc::Batch batch;
+		batch.AddOneWay<decltype(&functionD), functionD>(1);
+		batch.Add<decltype(&functionA), functionA>(1, 2.0f, 3ll);
+		batch.AddOneWay<decltype(&functionD), functionD>(2);
+		networking::Buffer frame;
+		batch.Finish(frame);
+		serialization::Reader batchReader(frame);
+		serialization::Writer results;
+		int32_t executed = rpc::FunctionRegistry::CallBatch(batchReader,
+				results);
+		rpc::BatchResponse response(results.GetBuffer());
+		int r = 0;
+		result = result && executed == 3 && response.Count() == 1
+			&& response.Next(r) == rpc::BatchResponse::RECORD_RETURNED
+			&& r == functionA(1, 2.0f, 3ll)
+			&& notified == 15;
+		printf(" test %i ... %s\n", 14, result?"OK":"FAILED");
+		if(result)
+			++valid;
+		else
+			++invalid;
+		++total;
+	}
+	
+	{
+		// Failed call in the middle does not end the response.
+		serialization::Writer results;
+		results << (int32_t)3;
+		results << (int32_t)4 << (int32_t)7;
+		results << (int32_t)-1;
+		results << (int32_t)4 << (int32_t)9;
+		rpc::BatchResponse response(results.GetBuffer());
+		int32_t a = 0, b = 0, c = 0, d = 0;
+		bool result = response.Next(a) == rpc::BatchResponse::RECORD_RETURNED
+			&& response.Next(b) == rpc::BatchResponse::RECORD_FAILED
+			&& response.Next(c) == rpc::BatchResponse::RECORD_RETURNED
+			&& response.Next(d) == rpc::BatchResponse::RECORD_END
+			&& a == 7 && b == 0 && c == 9;
+		printf(" test %i ... %s\n", 15, result?"OK":"FAILED");
+		if(result)
+			++valid;
+		else
+			++invalid;
+		++total;
+	}
 	
 	printf(" tests %i/%i ... OK\n", valid, total);
 	if(invalid)
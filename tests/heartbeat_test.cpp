@@ -0,0 +1,68 @@
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "Check.hpp"
+
+const char* path = "/tmp/dorpc_heartbeat_test.sock";
+
+// Only the server sends pings, client answers them without heartbeat of its
+// own. Server socket is paused for longer than maxMissed intervals, which
+// would close it if paused sockets were not exempt.
+networking::Loop* loop = NULL;
+networking::Context* server = NULL;
+uint64_t serverHandle = 0;
+
+int main() {
+	loop = networking::Loop::Make();
+	server = networking::Context::Make(loop, [](
+				networking::Socket*socket, int isClient, char* b, int c) {
+				serverHandle = socket->handle;
+				socket->InternalPauseReading();
+				loop->ScheduleAfter(10000, [](){
+						networking::Socket* socket =
+							server->GetSocket(serverHandle);
+						Check(2, socket != NULL);
+						if(socket == NULL)
+							exit(Finish());
+						socket->InternalResumeReading();
+					});
+			},
+			[](networking::Buffer& buffer, networking::Socket* socket){
+			}, NULL, NULL, NULL, NULL);
+	networking::Context* client = networking::Context::Make(loop, [](
+				networking::Socket*socket, int isClient, char* b, int c) {
+			},
+			[](networking::Buffer& buffer, networking::Socket* socket){
+			}, NULL, NULL, NULL, NULL);
+	
+	server->SetHeartbeat(1, 1000);
+	loop->Post([](){
+			Check(1, server->heartbeatMaxMissed
+					== networking::Socket::MAX_MISSED_HEARTBEATS);
+			server->SetHeartbeat(1, 1);
+		});
+	loop->ScheduleEvery(100, [](){
+			networking::Socket* socket = server->GetSocket(serverHandle);
+			if(socket == NULL || socket->readingPaused
+					|| socket->GetRtt() == 0)
+				return;
+			Check(3, true);
+			exit(Finish());
+		});
+	loop->ScheduleAfter(30000, [](){
+			Check(3, false);
+			exit(Finish());
+		});
+	
+	if(server->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	client->InternalConnectUnix(path);
+	loop->Run();
+	return 1;
+}
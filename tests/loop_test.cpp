@@ -0,0 +1,92 @@
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+
+const char* path = "/tmp/dorpc_loop_test.sock";
+const int posts = 1000;
+const int batch = 100;
+
+networking::Loop* loop = NULL;
+std::thread::id loopThread;
+int executed = 0;
+bool ordered = true;
+bool onLoopThread = true;
+
+int once = 0, repeated = 0, cancelled = 0;
+
+void StartTimers() {
+	loop->ScheduleAfter(5, [](){ ++once; });
+	static uint64_t every = 0;
+	every = loop->ScheduleEvery(5, [](){
+			if(++repeated == 3)
+				loop->CancelTimer(every);
+		});
+	uint64_t timer = loop->ScheduleAfter(20, [](){ ++cancelled; });
+	loop->CancelTimer(timer);
+	loop->ScheduleAfter(100, [](){
+			Check(4, once == 1);
+			Check(5, repeated == 3);
+			Check(6, cancelled == 0);
+			exit(Finish());
+		});
+}
+
+void Execute(int id) {
+	if(id != executed)
+		ordered = false;
+	if(std::this_thread::get_id() != loopThread)
+		onLoopThread = false;
+	++executed;
+}
+
+int main() {
+	// Callback of timer which never started is freed with the loop.
+	std::shared_ptr<int> captured = std::make_shared<int>(0);
+	networking::Loop* unused = networking::Loop::Make();
+	unused->ScheduleAfter(10, [captured](){});
+	bool pending = captured.use_count() == 2;
+	unused->InternalDestructor();
+	Check(1, pending && captured.use_count() == 1);
+	
+	loop = networking::Loop::Make();
+	// Listening socket only keeps the loop running.
+	networking::Context* context = networking::Context::Make(loop, [](
+				networking::Socket*socket, int isClient, char* b, int c) {
+			},
+			[](networking::Buffer& buffer, networking::Socket* socket){
+			}, NULL, NULL, NULL, NULL);
+	if(context->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	
+	std::thread producer([](){
+			for(int i=0; i<posts; ++i)
+				loop->Post([i](){ Execute(i); });
+			loop->Post([](){
+					Check(2, executed == posts && ordered && onLoopThread);
+				});
+			std::vector<std::function<void()>> callables;
+			for(int i=0; i<batch; ++i)
+				callables.emplace_back([i](){ Execute(posts+i); });
+			callables.emplace_back([](){
+					Check(3, executed == posts+batch && ordered
+							&& onLoopThread);
+					StartTimers();
+				});
+			loop->PostBatch(std::move(callables));
+		});
+	producer.detach();
+	
+	loopThread = std::this_thread::get_id();
+	loop->Run();
+	return 1;
+}
@@ -0,0 +1,91 @@
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+#include <networking/MemoryBudget.hpp>
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+
+const char* path = "/tmp/dorpc_memory_budget_test.sock";
+const int connections = 4;
+const int messages = 16;
+const int messageSize = 60000;
+
+// Server loop holds the budget, clients run on their own loop so their send
+// queues are not charged.
+networking::MemoryBudget budget(64*1024, 16*1024);
+networking::Loop* serverLoop = NULL;
+networking::Context* server = NULL;
+networking::Context* client = NULL;
+std::vector<uint64_t> clientHandles, serverHandles;
+int received = 0;
+bool sawPause = false;
+
+void SendMessage(networking::Context* context, uint64_t handle, int size) {
+	std::vector<uint8_t> data(size, 3);
+	networking::Buffer buffer;
+	buffer.Write(data.data(), size);
+	context->Send(handle, buffer);
+}
+
+int main() {
+	serverLoop = networking::Loop::Make();
+	serverLoop->SetMemoryBudget(&budget);
+	server = networking::Context::Make(serverLoop, [](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				serverHandles.push_back(socket->handle);
+			},
+			[](networking::Buffer& buffer, networking::Socket* socket){
+				if(serverLoop->pausedSockets->empty() == false)
+					sawPause = true;
+				if(buffer.Size() != messageSize) {
+					Check(3, false);
+					exit(Finish());
+				}
+				if(++received < connections*messages)
+					return;
+				Check(1, sawPause);
+				Check(2, budget.GetUsed() == 0 && serverLoop->pausedSockets
+						->empty() && socket->readingPaused == 0);
+				// Frame bigger than the whole budget closes the connection.
+				SendMessage(client, clientHandles[0], 100000);
+				serverLoop->ScheduleEvery(10, [](){
+						for(uint64_t handle : serverHandles) {
+							if(server->GetSocket(handle))
+								continue;
+							Check(3, budget.GetUsed() == 0);
+							exit(Finish());
+						}
+					});
+			}, NULL, NULL, NULL, NULL);
+	if(server->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	
+	networking::Loop* clientLoop = networking::Loop::Make();
+	client = networking::Context::Make(clientLoop, [](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				clientHandles.push_back(socket->handle);
+				for(int i=0; i<messages; ++i)
+					SendMessage(socket->context, socket->handle, messageSize);
+			},
+			[](networking::Buffer& buffer, networking::Socket* socket){
+			}, NULL, NULL, NULL, NULL);
+	for(int i=0; i<connections; ++i)
+		client->InternalConnectUnix(path);
+	std::thread clientThread([clientLoop](){
+			clientLoop->Run();
+		});
+	clientThread.detach();
+	
+	serverLoop->Run();
+	return 1;
+}
@@ -0,0 +1,62 @@
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Check.hpp"
+
+const char* path = "/tmp/dorpc_memory_test.sock";
+const int bigSize = 256*1024;
+
+networking::Context* context = NULL;
+
+int main() {
+	networking::Buffer big;
+	big.Resize(1<<20);
+	bool reserved = big.Capacity() >= (1<<20);
+	big.Destroy();
+	networking::Buffer reused;
+	reused.Write((uint8_t)1);
+	Check(1, reserved && big.Capacity() == 0 && reused.Capacity()
+			<= networking::Buffer::MAX_POOLED_CAPACITY);
+	
+	networking::Loop *loop = networking::Loop::Make();
+	context = networking::Context::Make(loop, [=](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				if(isClient == 0)
+					return;
+				std::vector<uint8_t> data(bigSize, 7);
+				networking::Buffer buffer;
+				buffer.Write(data.data(), data.size());
+				socket->InternalSend(buffer);
+				buffer.Clear();
+				buffer.Write("small", 6);
+				socket->InternalSend(buffer);
+			},
+			[=](networking::Buffer& buffer, networking::Socket* socket){
+				size_t usage = socket->GetMemoryUsage();
+				if(buffer.Size() == bigSize) {
+					// Message being delivered is still owned by the socket.
+					Check(2, usage >= sizeof(networking::Socket) + bigSize
+							&& context->GetMemoryUsage() >= usage);
+					return;
+				}
+				// Previous big buffer went back to the pool after delivery.
+				Check(3, strcmp((const char*)buffer.Data(), "small") == 0
+						&& usage < sizeof(networking::Socket) + 4096);
+				exit(Finish());
+			}, NULL, NULL, NULL, NULL);
+	
+	if(context->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	context->InternalConnectUnix(path);
+	loop->Run();
+	return 1;
+}
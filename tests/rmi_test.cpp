@@ -0,0 +1,548 @@
+
+#include <rpc/FunctionRegistry.hpp>
+#include <rmi/Method.hpp>
+#include <rpc/Batch.hpp>
+#include <rmi/Scheduler.hpp>
+#include <rmi/Snapshot.hpp>
+#include <rmi/ObjectGuard.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "Check.hpp"
+
+class Counter : public rmi::Object {
+public:
+	int64_t Add(int64_t value) {
+		return sum += value;
+	}
+	std::string Describe(const std::string& prefix) const {
+		return prefix + std::to_string(sum);
+	}
+	void Reset() {
+		sum = 0;
+	}
+	void Serialize(serialization::Writer& writer) const override {
+		writer << sum;
+	}
+	void Deserialize(serialization::Reader& reader) override {
+		reader >> sum;
+	}
+	int64_t sum = 0;
+};
+
+class Other : public rmi::Object {
+public:
+	void Nothing() {}
+};
+
+class Tracked : public rmi::Object {
+public:
+	~Tracked() { ++destroyed; }
+	static inline int destroyed = 0;
+};
+
+// Runs in a new process, which does not know id ranges of the snapshot.
+static int RehydrateInFreshProcess(const char* path, rmi::ObjectId id) {
+	rmi::ObjectRegistry::SetLocalNode(1);
+	rmi::Snapshot* snapshot = rmi::Snapshot::Open(path);
+	if(snapshot == NULL)
+		return 1;
+	rmi::ObjectGuard guard;
+	// Record outside of known ranges cannot be imported yet, but is kept.
+	const bool kept = snapshot->Rehydrate(id) == NULL
+		&& snapshot->Contains(id) && snapshot->GetPendingCount() == 1;
+	snapshot->Attach();
+	Counter* counter = dynamic_cast<Counter*>(rmi::ObjectRegistry::Get(id));
+	const bool restored = counter && counter->sum == 42
+		&& snapshot->GetPendingCount() == 0;
+	snapshot->Detach();
+	delete snapshot;
+	return kept && restored ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	REGISTER_METHOD(Counter, Add);
+	REGISTER_METHOD(Counter, Describe);
+	REGISTER_METHOD(Counter, Reset);
+	REGISTER_OBJECT_TYPE(Counter);
+	if(argc == 4 && strcmp(argv[1], "rehydrate") == 0)
+		return RehydrateInFreshProcess(argv[2], strtoull(argv[3], NULL, 10));
+	
+	rmi::ObjectRegistry::SetLocalNode(1);
+	rmi::ObjectRegistry::AddLocalRange(1<<20, 2<<20);
+	rmi::ObjectRegistry::AddRemoteRange(2<<20, 3<<20, 2);
+	
+	std::vector<Counter*> counters;
+	bool added = true;
+	for(int i=0; i<100000; ++i) {
+		counters.push_back(new Counter());
+		rmi::ObjectId id = rmi::ObjectRegistry::Add(counters.back());
+		added &= id == (rmi::ObjectId)(1<<20) + i
+			&& counters.back()->GetObjectId() == id;
+	}
+	bool found = true;
+	for(Counter* c : counters)
+		found &= rmi::ObjectRegistry::Get(c->GetObjectId()) == c;
+	Check(1, added && found
+			&& rmi::ObjectRegistry::GetTable().Size() == counters.size());
+	
+	Check(2, rmi::ObjectRegistry::GetOwner(counters[5]->GetObjectId()) == 1
+			&& rmi::ObjectRegistry::GetOwner((2<<20) + 5) == 2
+			&& rmi::ObjectRegistry::GetOwner(3<<20) == 0
+			&& rmi::ObjectRegistry::Get((2<<20) + 5) == NULL);
+	
+	Counter* counter = counters[1234];
+	serialization::Writer call, returned;
+	rmi::Method<decltype(&Counter::Add), &Counter::Add>::PrepareCall(call,
+			counter->GetObjectId(), 40);
+	serialization::Reader callReader(call.GetBuffer());
+	int64_t sum = 0;
+	bool result = rpc::FunctionRegistry::Dispatch(callReader, returned)
+		== rpc::FunctionRegistry::CALL_RETURNED;
+	serialization::Reader retReader(returned.GetBuffer());
+	retReader >> sum;
+	Check(3, result && sum == 40 && counter->sum == 40);
+	
+	rpc::Batch batch;
+	networking::Buffer frame;
+	serialization::Writer results;
+	for(Counter* c : counters)
+		batch.AddOneWay<decltype(&Counter::Add), &Counter::Add>(
+				c->GetObjectId(), 2);
+	batch.Add<decltype(&Counter::Describe), &Counter::Describe>(
+			counter->GetObjectId(), "sum=");
+	batch.Finish(frame);
+	serialization::Reader batchReader(frame);
+	int32_t executed = rpc::FunctionRegistry::CallBatch(batchReader, results);
+	rpc::BatchResponse response(results.GetBuffer());
+	std::string description;
+	Check(4, executed == (int32_t)counters.size() + 1
+			&& response.Next(description)
+			== rpc::BatchResponse::RECORD_RETURNED
+			&& description == "sum=42");
+	
+	// Unknown object and object of different class.
+	Other* other = new Other();
+	rmi::ObjectRegistry::Add(other);
+	serialization::Writer missing, wrongClass, r1, r2;
+	rmi::Method<decltype(&Counter::Reset), &Counter::Reset>::PrepareCall(
+			missing, (rmi::ObjectId)(2<<20) + 5);
+	rmi::Method<decltype(&Counter::Reset), &Counter::Reset>::PrepareCall(
+			wrongClass, other->GetObjectId());
+	serialization::Reader missingReader(missing.GetBuffer());
+	serialization::Reader wrongClassReader(wrongClass.GetBuffer());
+	Check(5, rpc::FunctionRegistry::Dispatch(missingReader, r1)
+			== rpc::FunctionRegistry::CALL_TARGET_NOT_FOUND
+			&& rpc::FunctionRegistry::Dispatch(wrongClassReader, r2)
+			== rpc::FunctionRegistry::CALL_TARGET_NOT_FOUND);
+	
+	rmi::ObjectRegistry::Remove(counter->GetObjectId());
+	Check(6, rmi::ObjectRegistry::Get(counter->GetObjectId()) == NULL
+			&& rmi::ObjectRegistry::GetOwner(counter->GetObjectId()) == 1);
+	
+	rmi::RangeMap ranges;
+	ranges.Add(0, 100, 1);
+	ranges.Add(40, 60, 2);
+	Check(7, ranges.Find(39) == 1 && ranges.Find(40) == 2
+			&& ranges.Find(59) == 2 && ranges.Find(60) == 1
+			&& ranges.Find(100) == 0 && ranges.Size() == 3);
+	
+	// Migration to node 3, replayed locally as if node 3 received it.
+	Counter* migrated = counters[77];
+	const rmi::ObjectId migratedId = migrated->GetObjectId();
+	serialization::Writer importCall, originCall, r3;
+	rmi::NodeId originNode = 0;
+	bool moved = rmi::ObjectRegistry::Migrate(migratedId, 3, importCall,
+			originCall, originNode);
+	Check(8, moved && originNode == 0
+			&& rmi::ObjectRegistry::Get(migratedId) == NULL
+			&& rmi::ObjectRegistry::GetOwner(migratedId) == 3
+			&& rmi::ObjectRegistry::GetForwardTarget(migratedId) == 3
+			&& rmi::ObjectRegistry::GetForwardTarget(
+				counters[78]->GetObjectId()) == 0);
+	
+	serialization::Writer forwarded;
+	rmi::Method<decltype(&Counter::Add), &Counter::Add>::PrepareOneWayCall(
+			forwarded, migratedId, 1);
+	Check(9, rmi::ObjectRegistry::PeekTargetObject(forwarded.GetBuffer())
+			== migratedId
+			&& rmi::ObjectRegistry::PeekTargetObject(importCall.GetBuffer())
+			== 0);
+	
+	serialization::Reader importReader(importCall.GetBuffer());
+	Counter* imported = NULL;
+	bool dispatched = rpc::FunctionRegistry::Dispatch(importReader, r3)
+		== rpc::FunctionRegistry::CALL_ONE_WAY;
+	imported = dynamic_cast<Counter*>(rmi::ObjectRegistry::Get(migratedId));
+	Check(10, dispatched && imported && imported->sum == 2
+			&& rmi::ObjectRegistry::GetOwner(migratedId) == 1);
+	
+	serialization::Writer hint, r4;
+	rmi::ObjectRegistry::WriteLocationHint(hint, (2<<20) + 9, 4);
+	serialization::Reader hintReader(hint.GetBuffer());
+	rpc::FunctionRegistry::Dispatch(hintReader, r4);
+	rmi::LocationCache& cache = rmi::ObjectRegistry::GetLocationCache();
+	bool hinted = rmi::ObjectRegistry::Route((2<<20) + 9) == 4;
+	cache.Invalidate((2<<20) + 9, 5);
+	bool kept = rmi::ObjectRegistry::Route((2<<20) + 9) == 4;
+	cache.Invalidate((2<<20) + 9, 4);
+	Check(11, hinted && kept
+			&& rmi::ObjectRegistry::Route((2<<20) + 9) == 2);
+	
+	networking::Buffer announced;
+	rmi::NodeId announcedTo = 99;
+	rmi::ObjectRegistry::SetLeaseTransport([&](rmi::NodeId node,
+				serialization::Writer& call) {
+				announcedTo = node;
+				announced.Clear();
+				announced.Write(call.GetBuffer().Data(),
+						call.GetBuffer().Size());
+			});
+	rmi::ObjectRegistry::SetLeader(1);
+	rmi::ObjectRegistry::SetLeaseSpace(1ull<<32, 1ull<<40);
+	const rmi::ObjectId freeIds = rmi::ObjectRegistry::GetFreeIdCount();
+	rmi::ObjectRegistry::RequestLease();
+	bool leased = rmi::ObjectRegistry::GetFreeIdCount()
+		== freeIds + rmi::ObjectRegistry::LEASE_SIZE
+		&& rmi::ObjectRegistry::GetOwner(1ull<<32) == 1 && announcedTo == 0;
+	announcedTo = 99;
+	bool granted = rmi::ObjectRegistry::GrantLease(7);
+	serialization::Writer r5;
+	serialization::Reader announcedReader(announced);
+	rmi::ObjectRegistry::SetSenderNode(1);
+	bool applied = rpc::FunctionRegistry::Dispatch(announcedReader, r5)
+		== rpc::FunctionRegistry::CALL_ONE_WAY;
+	Check(12, leased && granted && applied && announcedTo == 0
+			&& rmi::ObjectRegistry::GetOwner((1ull<<32)
+				+ rmi::ObjectRegistry::LEASE_SIZE) == 7);
+	
+	std::vector<rmi::ObjectId> ids[4];
+	std::vector<std::thread> threads;
+	for(int t=0; t<4; ++t) {
+		threads.emplace_back([&ids, t]() {
+				for(int i=0; i<50000; ++i)
+					ids[t].push_back(rmi::ObjectRegistry::Add(new Counter()));
+				});
+	}
+	std::vector<rmi::ObjectId> allIds;
+	for(int t=0; t<4; ++t) {
+		threads[t].join();
+		allIds.insert(allIds.end(), ids[t].begin(), ids[t].end());
+	}
+	std::sort(allIds.begin(), allIds.end());
+	Check(13, allIds.front() != 0
+			&& std::unique(allIds.begin(), allIds.end()) == allIds.end());
+	
+	// Unsynchronized counters stay exact only if calls of one object never
+	// overlap.
+	rmi::Scheduler scheduler(4);
+	std::vector<Counter*> actors;
+	std::atomic<int> inside[64], overlaps = 0, finished = 0;
+	for(int i=0; i<64; ++i) {
+		actors.push_back(new Counter());
+		rmi::ObjectRegistry::Add(actors.back());
+		inside[i] = 0;
+	}
+	std::vector<std::thread> producers;
+	for(int t=0; t<4; ++t) {
+		producers.emplace_back([&, t]() {
+				for(int i=0; i<25000; ++i) {
+					const int a = (i*7 + t) % 64;
+					Counter* actor = actors[a];
+					scheduler.Post(actor->GetObjectId(), [&, actor, a]() {
+							if(inside[a].fetch_add(1) != 0)
+								++overlaps;
+							actor->sum++;
+							inside[a].fetch_sub(1);
+							++finished;
+							});
+				}
+				});
+	}
+	for(std::thread& producer : producers)
+		producer.join();
+	serialization::Writer scheduledCall;
+	std::atomic<int64_t> scheduledSum = -1;
+	rmi::Method<decltype(&Counter::Add), &Counter::Add>::PrepareCall(
+			scheduledCall, actors[3]->GetObjectId(), 0);
+	bool posted = scheduler.PostCall(scheduledCall.GetBuffer(),
+			[&](serialization::Writer& writer) {
+				int64_t value = 0;
+				serialization::Reader reader(writer.GetBuffer());
+				reader >> value;
+				scheduledSum = value;
+			});
+	for(int i=0; i<10000 && (finished < 100000 || scheduledSum < 0); ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	int64_t actorsSum = 0;
+	for(Counter* actor : actors)
+		actorsSum += actor->sum;
+	Check(14, posted && finished == 100000 && overlaps == 0
+			&& actorsSum == 100000 && scheduledSum == actors[3]->sum);
+	scheduler.Stop();
+	
+	const char* snapshotPath = "/tmp/dorpc_rmi_test.snapshot";
+	unlink(snapshotPath);
+	rmi::Snapshot* snapshot = rmi::Snapshot::Open(snapshotPath);
+	snapshot->Attach();
+	std::vector<rmi::ObjectId> stored;
+	for(int i=0; i<1000; ++i) {
+		Counter* c = new Counter();
+		c->sum = i;
+		stored.push_back(rmi::ObjectRegistry::Add(c));
+		snapshot->MarkDirty(stored.back());
+	}
+	int64_t full = snapshot->Write();
+	((Counter*)rmi::ObjectRegistry::Get(stored[7]))->sum = 700;
+	snapshot->MarkDirty(stored[7]);
+	delete rmi::ObjectRegistry::Remove(stored[8]);
+	int64_t incremental = snapshot->Write();
+	// Restart: objects are gone from memory, file is indexed again.
+	snapshot->Detach();
+	delete snapshot;
+	for(rmi::ObjectId id : stored)
+		delete rmi::ObjectRegistry::Remove(id);
+	snapshot = rmi::Snapshot::Open(snapshotPath);
+	snapshot->Attach();
+	size_t indexed = snapshot->GetPendingCount();
+	Counter* restored = dynamic_cast<Counter*>(
+			rmi::ObjectRegistry::Get(stored[5]));
+	Counter* modified = dynamic_cast<Counter*>(
+			rmi::ObjectRegistry::Get(stored[7]));
+	bool compacted = snapshot->Compact();
+	Counter* afterCompaction = dynamic_cast<Counter*>(
+			rmi::ObjectRegistry::Get(stored[9]));
+	Check(15, full == 1000 && incremental == 2 && indexed == 999
+			&& restored && restored->sum == 5 && modified
+			&& modified->sum == 700
+			&& rmi::ObjectRegistry::Get(stored[8]) == NULL
+			&& compacted && afterCompaction && afterCompaction->sum == 9
+			&& snapshot->GetPendingCount() == 996);
+	snapshot->Detach();
+	delete snapshot;
+	unlink(snapshotPath);
+	
+	// Object destroyed while another guard uses it is deleted by the first
+	// Reclaim after the guard, guard exit itself only publishes it.
+	rmi::ObjectId trackedId = rmi::ObjectRegistry::Add(new Tracked());
+	bool pinned = false;
+	{
+		rmi::ObjectGuard guard;
+		rmi::Object* tracked = rmi::ObjectRegistry::Get(trackedId);
+		std::thread([trackedId]() {
+				rmi::ObjectRegistry::Destroy(trackedId);
+			}).join();
+		pinned = tracked && Tracked::destroyed == 0
+			&& rmi::ObjectGuard::GetRetiredCount() == 1;
+	}
+	pinned = pinned && Tracked::destroyed == 0;
+	rmi::ObjectGuard::Reclaim();
+	Check(16, pinned && Tracked::destroyed == 1
+			&& rmi::ObjectGuard::GetRetiredCount() == 0
+			&& rmi::ObjectRegistry::Get(trackedId) == NULL);
+	
+	// Metadata from peers is accepted only for ids this node is responsible
+	// for.
+	const rmi::ObjectId movedId = counters[79]->GetObjectId();
+	serialization::Writer moveCall, moveOrigin, missHint, miss, r7, r8;
+	rmi::ObjectRegistry::Migrate(movedId, 3, moveCall, moveOrigin,
+			originNode);
+	bool validated = rmi::ObjectRegistry::Import(1ull<<60, "Counter", "")
+			== false
+		&& rmi::ObjectRegistry::UpdateLocation((2<<20) + 9, 5) == false
+		&& rmi::ObjectRegistry::UpdateLocation(migratedId, 5) == false
+		&& rmi::ObjectRegistry::UpdateLocation(movedId, 4)
+		&& rmi::ObjectRegistry::GetOwner(movedId) == 4
+		&& rmi::ObjectRegistry::GetOwner((2<<20) + 9) == 2;
+	// Node which missed the object drops it from cache of the caller.
+	rmi::ObjectRegistry::WriteLocationHint(missHint, (2<<20) + 9, 1);
+	rmi::ObjectRegistry::WriteLocationMiss(miss, (2<<20) + 9);
+	serialization::Reader missHintReader(missHint.GetBuffer());
+	serialization::Reader missReader(miss.GetBuffer());
+	rpc::FunctionRegistry::Dispatch(missHintReader, r7);
+	bool cached = rmi::ObjectRegistry::Route((2<<20) + 9) == 1;
+	rpc::FunctionRegistry::Dispatch(missReader, r8);
+	Check(17, validated && cached
+			&& rmi::ObjectRegistry::Route((2<<20) + 9) == 2);
+	
+	// Lease request is granted only to node of the link it came from.
+	rmi::ObjectRegistry::SetLeader(2);
+	rmi::ObjectRegistry::RequestLease();
+	networking::Buffer request(std::move(announced));
+	const rmi::NodeId requestedFrom = announcedTo;
+	rmi::ObjectRegistry::SetLeader(1);
+	const rmi::ObjectId beforeRequest = rmi::ObjectRegistry::GetFreeIdCount();
+	serialization::Writer r9, r10;
+	serialization::Reader spoofedReader(request);
+	rmi::ObjectRegistry::SetSenderNode(3);
+	rpc::FunctionRegistry::Dispatch(spoofedReader, r9);
+	bool spoofed = rmi::ObjectRegistry::GetFreeIdCount() == beforeRequest;
+	serialization::Reader requestReader(request);
+	rmi::ObjectRegistry::SetSenderNode(1);
+	rpc::FunctionRegistry::Dispatch(requestReader, r10);
+	rmi::ObjectRegistry::SetSenderNode(0);
+	Check(18, requestedFrom == 2 && spoofed
+			&& rmi::ObjectRegistry::GetFreeIdCount()
+			== beforeRequest + rmi::ObjectRegistry::LEASE_SIZE);
+	
+	// Object waiting behind a blocked worker is stolen by the idle one.
+	std::vector<Counter*> homed;
+	{
+		rmi::Scheduler stealing(2);
+		for(Counter* actor : actors)
+			if(stealing.GetHomeWorker(actor->GetObjectId()) == 0)
+				homed.push_back(actor);
+		std::atomic<bool> released = false, blocked = false;
+		stealing.Post(homed[0]->GetObjectId(), [&]() {
+				blocked = true;
+				for(int i=0; i<5000 && released == false; ++i)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				});
+		while(blocked == false)
+			std::this_thread::yield();
+		stealing.Post(homed[1]->GetObjectId(), [&]() { released = true; });
+		for(int i=0; i<5000 && released == false; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		Check(19, released && stealing.GetStolenCount() >= 1);
+	}
+	
+	// Calls left by Stop are dropped, the object can be scheduled again.
+	std::atomic<int> ran = 0;
+	rmi::Scheduler stopped(1);
+	std::atomic<bool> unblock = false, started = false;
+	for(uint32_t i=0; i<rmi::Scheduler::BATCH+10; ++i)
+		stopped.Post(homed[2]->GetObjectId(), [&]() {
+				started = true;
+				while(unblock == false)
+					std::this_thread::yield();
+				++ran;
+				});
+	while(started == false)
+		std::this_thread::yield();
+	std::thread unblocker([&]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			unblock = true;
+			});
+	stopped.Stop();
+	unblocker.join();
+	bool rejected = stopped.Post(homed[2]->GetObjectId(), [&]() {
+			++ran;
+			}) == false;
+	const int ranBeforeStop = ran;
+	rmi::Scheduler restarted(1);
+	restarted.Post(homed[2]->GetObjectId(), [&]() { ran += 1000; });
+	for(int i=0; i<5000 && ran < 1000; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	Check(20, rejected && ranBeforeStop == (int)rmi::Scheduler::BATCH
+			&& ran == ranBeforeStop + 1000);
+	restarted.Stop();
+	
+	// Objects of a scheduler are serialized between their calls.
+	unlink(snapshotPath);
+	snapshot = rmi::Snapshot::Open(snapshotPath);
+	snapshot->Attach();
+	rmi::Scheduler writers(2);
+	std::atomic<int> incremented = 0;
+	for(int i=0; i<1000; ++i)
+		writers.Post(actors[i%8]->GetObjectId(), [&, i]() {
+				actors[i%8]->sum += 1;
+				++incremented;
+				});
+	for(int i=0; i<8; ++i)
+		snapshot->MarkDirty(actors[i]->GetObjectId());
+	const int64_t scheduledWrite = snapshot->Write(&writers);
+	for(int i=0; i<5000 && incremented < 1000; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	writers.Stop();
+	snapshot->Detach();
+	delete snapshot;
+	Check(21, scheduledWrite == 8 && incremented == 1000);
+	unlink(snapshotPath);
+	
+	// Ids far apart use only the chunks they need, replaced directories
+	// are freed once no guard can read them.
+	{
+		rmi::ObjectTable sparse;
+		std::vector<rmi::ObjectId> far;
+		for(int i=0; i<100; ++i)
+			far.push_back(((uint64_t)i << 40) + i + 1);
+		far.push_back(UINT64_MAX);
+		bool stored = true;
+		for(rmi::ObjectId id : far)
+			stored = sparse.Insert(id, actors[0]) && stored;
+		rmi::ObjectGuard guard;
+		bool found = sparse.Get(UINT64_MAX) == actors[0]
+			&& sparse.Get(((uint64_t)50 << 40) + 52) == NULL;
+		for(rmi::ObjectId id : far)
+			found = found && sparse.Get(id) == actors[0];
+		Check(22, stored && found && sparse.Size() == far.size()
+				&& sparse.Insert(far[3], actors[1]) == false
+				&& sparse.Remove(far[3]) == actors[0]
+				&& sparse.Get(far[3]) == NULL
+				&& rmi::ObjectGuard::GetRetiredCount() == 0);
+	}
+	
+	// Add skips ids already taken by inserted objects.
+	rmi::ObjectId beforeTaken = rmi::ObjectRegistry::Add(new Counter());
+	rmi::ObjectRegistry::Insert(beforeTaken+1, new Counter());
+	rmi::ObjectId afterTaken = rmi::ObjectRegistry::Add(new Counter());
+	Check(23, beforeTaken && afterTaken && afterTaken != beforeTaken+1
+			&& rmi::ObjectRegistry::Add(NULL) == 0);
+	
+	// Calls posted from many threads to a busy object never overlap.
+	{
+		rmi::Scheduler busy(4);
+		const rmi::ObjectId busyId = actors[1]->GetObjectId();
+		std::atomic<bool> inside = false, overlapped = false;
+		std::atomic<int> finished = 0;
+		int calls = 0;
+		std::vector<std::thread> posters;
+		for(int t=0; t<4; ++t)
+			posters.emplace_back([&]() {
+					for(int i=0; i<20000; ++i)
+						busy.Post(busyId, [&]() {
+								if(inside.exchange(true))
+									overlapped = true;
+								++calls;
+								inside = false;
+								++finished;
+							});
+				});
+		for(std::thread& poster : posters)
+			poster.join();
+		for(int i=0; i<10000 && finished < 80000; ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		busy.Stop();
+		Check(24, overlapped == false && calls == 80000);
+	}
+	
+	// Restarted process imports records, it learns their ranges from the
+	// snapshot.
+	unlink(snapshotPath);
+	snapshot = rmi::Snapshot::Open(snapshotPath);
+	snapshot->Attach();
+	Counter* persisted = new Counter();
+	persisted->sum = 42;
+	const rmi::ObjectId persistedId = rmi::ObjectRegistry::Add(persisted);
+	snapshot->MarkDirty(persistedId);
+	const int64_t persistedWrite = snapshot->Write();
+	snapshot->Detach();
+	delete snapshot;
+	const std::string restart = std::string(argv[0]) + " rehydrate "
+		+ snapshotPath + " " + std::to_string(persistedId);
+	Check(25, persistedWrite == 1 && system(restart.c_str()) == 0);
+	unlink(snapshotPath);
+	
+	return Finish();
+}
+
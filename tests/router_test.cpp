@@ -0,0 +1,96 @@
+
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+#include <networking/Router.hpp>
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+
+#include "Check.hpp"
+
+const char* path = "/tmp/dorpc_router_test.sock";
+
+// Node 1 owns client sockets, node 2 owns server sockets. Messages of node 1
+// addressed to node 1 go through node 2, which forwards them back.
+networking::Router node1, node2;
+std::set<networking::Socket*> serverSockets;
+
+void SendText(networking::Socket* socket, uint32_t destination, uint8_t ttl,
+		const char* text) {
+	networking::Buffer buffer;
+	networking::Router::WriteHeader(buffer, destination, ttl);
+	buffer.Write(text, strlen(text)+1);
+	socket->InternalSend(buffer);
+}
+
+int main() {
+	networking::Router::Header header;
+	networking::Buffer message;
+	networking::Router::WriteHeader(message, 0x01020304, 7, 3);
+	Check(1, networking::Router::ReadHeader(message, header)
+			&& header.destination == 0x01020304 && header.ttl == 7
+			&& header.flags == 3 && message.Size()
+			== networking::Router::HEADER_SIZE);
+	
+	networking::Router router;
+	networking::Context* context = NULL;
+	uint64_t handle = 0;
+	router.SetRoute(5, (networking::Context*)&router, 11);
+	bool direct = router.GetRoute(5, context, handle) && handle == 11;
+	bool missing = router.GetRoute(6, context, handle) == false;
+	router.SetRoute(0, (networking::Context*)&router, 12);
+	bool fallback = router.GetRoute(6, context, handle) && handle == 12;
+	router.RemoveRoutesVia((networking::Context*)&router, 12);
+	Check(2, direct && missing && fallback
+			&& router.GetRoute(6, context, handle) == false);
+	
+	node1.SetLocalNode(1);
+	node2.SetLocalNode(2);
+	
+	networking::Loop *loop = networking::Loop::Make();
+	context = networking::Context::Make(loop, [=](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				if(isClient == 0) {
+					serverSockets.insert(socket);
+					node2.SetRoute(1, socket->context, socket->handle);
+					return;
+				}
+				node1.SetRoute(2, socket->context, socket->handle);
+				SendText(socket, 2, networking::Router::DEFAULT_TTL, "direct");
+				SendText(socket, 1, 1, "expired");
+				SendText(socket, 1, networking::Router::DEFAULT_TTL,
+						"forwarded");
+			},
+			[=](networking::Buffer& buffer, networking::Socket* socket){
+				networking::Router& router = serverSockets.count(socket)
+					? node2 : node1;
+				networking::Router::Header header;
+				networking::Router::ReadHeader(buffer, header);
+				if(router.OnMessage(buffer, socket)
+						!= networking::Router::DELIVER)
+					return;
+				const char* text = (const char*)buffer.Data()
+					+ networking::Router::HEADER_SIZE;
+				if(&router == &node2) {
+					Check(3, strcmp(text, "direct") == 0);
+					return;
+				}
+				Check(4, strcmp(text, "forwarded") == 0
+						&& header.ttl == networking::Router::DEFAULT_TTL-1
+						&& node2.GetForwardedCount() == 1
+						&& node2.GetDroppedCount() == 1);
+				exit(Finish());
+			}, NULL, NULL, NULL, NULL);
+	
+	if(context->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	context->InternalConnectUnix(path);
+	loop->Run();
+	return 1;
+}
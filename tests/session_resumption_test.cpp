@@ -0,0 +1,58 @@
+
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+
+#include <cstring>
+#include <cstdint>
+
+const uint16_t port = 12347;
+const int reconnects = 8;
+
+int rounds = 0;
+
+int main() {
+	networking::Loop *loop = networking::Loop::Make();
+	networking::Context* context = NULL;
+	context = networking::Context::Make(loop, [&](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				socket->userData = (void*)(intptr_t)isClient;
+				if(isClient) {
+					networking::Buffer buffer;
+					buffer.Write("hello", 6);
+					socket->InternalSend(buffer);
+				}
+			},
+			[&](networking::Buffer& buffer, networking::Socket* socket){
+				if(socket->userData == NULL) {
+					networking::Buffer reply;
+					reply.Write("bye", 4);
+					socket->InternalSend(reply);
+					return;
+				}
+				socket->InternalClose();
+				rounds++;
+				if(rounds < reconnects) {
+					context->InternalConnect("127.0.0.1", port);
+					return;
+				}
+				networking::SessionStats stats = context->GetSessionStats();
+				printf(" client handshakes: %i, resumed: %i (%.0f%%)\n",
+						(int)stats.clientHandshakes, (int)stats.clientResumed,
+						stats.ClientHitRate()*100.0);
+				printf(" server handshakes: %i, resumed: %i (%.0f%%)\n",
+						(int)stats.serverHandshakes, (int)stats.serverResumed,
+						stats.ServerHitRate()*100.0);
+				bool valid = stats.clientResumed > 0 && stats.serverResumed > 0;
+				printf(" session resumption ... %s\n", valid?"OK":"FAILED");
+				exit(valid ? 0 : 1);
+			}, "cert/user.key",
+			"cert/user.crt", "cert/rootca.crt", NULL);
+	
+	context->StartListening("127.0.0.1", port);
+	context->InternalConnect("127.0.0.1", port);
+	loop->Run();
+	return 1;
+}
+
@@ -0,0 +1,81 @@
+
+#include <networking/SharedMemoryChannel.hpp>
+
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+const char* name = "/dorpc_shared_memory_test";
+const int roundTrips = 100000;
+
+int main() {
+	networking::SharedMemoryChannel* server =
+		networking::SharedMemoryChannel::Create(name, [](
+					networking::Buffer& buffer,
+					networking::Endpoint endpoint) {
+				endpoint.Send(buffer);
+			}, 1<<16);
+	if(server == NULL) {
+		printf(" cannot create shared memory %s ... FAILED\n", name);
+		return 1;
+	}
+	std::thread thread([=](){server->Run();});
+	
+	int received = 0, invalid = 0;
+	uint32_t expected = 0;
+	networking::SharedMemoryChannel* client =
+		networking::SharedMemoryChannel::Open(name, [&](
+					networking::Buffer& buffer,
+					networking::Endpoint endpoint) {
+				uint32_t value = 0;
+				if(buffer.Size() == sizeof(value))
+					memcpy(&value, buffer.Data(), sizeof(value));
+				if(value != expected)
+					++invalid;
+				++received;
+			});
+	if(client == NULL) {
+		printf(" cannot open shared memory %s ... FAILED\n", name);
+		server->Close();
+		thread.join();
+		delete server;
+		return 1;
+	}
+	
+	auto begin = std::chrono::steady_clock::now();
+	for(uint32_t i=0; i<roundTrips; ++i) {
+		expected = i*7919;
+		client->Send(&expected, sizeof(expected));
+		while(client->Poll() == 0)
+			std::this_thread::yield();
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end-begin).count();
+	printf(" %i round trips, %.0f ns per round trip\n", received,
+			ns/roundTrips);
+	
+	client->Close();
+	thread.join();
+	delete client;
+	delete server;
+	
+	bool valid = received == roundTrips && invalid == 0;
+	printf(" shared memory channel ... %s\n", valid?"OK":"FAILED");
+	
+	// Nobody reads this channel, so Send must give up once it is full.
+	networking::SharedMemoryChannel* full =
+		networking::SharedMemoryChannel::Create(name, NULL, 4096);
+	char block[1000] = {0};
+	int sent = 0;
+	begin = std::chrono::steady_clock::now();
+	while(sent < 100 && full && full->Send(block, sizeof(block), 10))
+		++sent;
+	end = std::chrono::steady_clock::now();
+	bool timedOut = full && sent == 4 && end-begin
+		< std::chrono::milliseconds(1000);
+	printf(" send timeout on full ring ... %s\n", timedOut?"OK":"FAILED");
+	delete full;
+	return valid && timedOut ? 0 : 1;
+}
+
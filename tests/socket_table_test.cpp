@@ -0,0 +1,48 @@
+
+#include <networking/SocketTable.hpp>
+
+#include <vector>
+#include <set>
+#include <cstdio>
+
+#include "Check.hpp"
+
+int main() {
+	networking::SocketTable table;
+	std::vector<networking::Socket*> sockets;
+	std::vector<uint64_t> handles;
+	for(intptr_t i=1; i<=1000; ++i) {
+		sockets.push_back((networking::Socket*)i);
+		handles.push_back(table.Insert(sockets.back()));
+	}
+	
+	bool found = true;
+	for(size_t i=0; i<handles.size(); ++i)
+		found &= table.Get(handles[i]) == sockets[i];
+	Check(1, found && table.size() == 1000);
+	
+	for(size_t i=0; i<handles.size(); i+=2)
+		table.Erase(handles[i]);
+	bool stale = true;
+	for(size_t i=0; i<handles.size(); ++i)
+		stale &= table.Get(handles[i]) == (i%2 ? sockets[i] : NULL);
+	Check(2, stale && table.size() == 500);
+	
+	std::set<networking::Socket*> iterated(table.begin(), table.end());
+	bool iteration = iterated.size() == 500;
+	for(size_t i=1; i<handles.size(); i+=2)
+		iteration &= iterated.count(sockets[i]) == 1;
+	Check(3, iteration);
+	
+	uint64_t reused = table.Insert((networking::Socket*)7777);
+	Check(4, networking::SocketTable::Index(reused)
+			== networking::SocketTable::Index(handles[998])
+			&& reused != handles[998]
+			&& table.Get(handles[998]) == NULL
+			&& table.Get(reused) == (networking::Socket*)7777);
+	
+	Check(5, table.Erase(handles[0]) == false && table.Get(0) == NULL);
+	
+	return Finish();
+}
+
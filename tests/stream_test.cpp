@@ -0,0 +1,138 @@
+
+#include <rpc/Stream.hpp>
+#include <rpc/FunctionBase.hpp>
+
+#include <deque>
+#include <vector>
+#include <cstdio>
+
+#include "Check.hpp"
+
+// Frames in flight between two managers, delivered on demand.
+std::deque<networking::Buffer> toServer, toClient;
+
+void Deliver(rpc::StreamManager& client, rpc::StreamManager& server) {
+	while(toServer.size() || toClient.size()) {
+		while(toServer.size()) {
+			networking::Buffer frame = std::move(toServer.front());
+			toServer.pop_front();
+			server.OnFrame(frame);
+		}
+		while(toClient.size()) {
+			networking::Buffer frame = std::move(toClient.front());
+			toClient.pop_front();
+			client.OnFrame(frame);
+		}
+	}
+}
+
+int main() {
+	rpc::StreamManager client([](networking::Buffer& frame) {
+			toServer.emplace_back(std::move(frame));
+		});
+	rpc::StreamManager server([](networking::Buffer& frame) {
+			toClient.emplace_back(std::move(frame));
+		});
+	
+	uint64_t received = 0, checksum = 0, maxInFlight = 0;
+	int32_t metadata = 0;
+	bool ended = false, reset = false;
+	rpc::StreamManager::RegisterHandler("upload",
+			[&](rpc::IncomingStream* stream, serialization::Reader& reader) {
+				reader >> metadata;
+				stream->onChunk = [&](const uint8_t* data, int32_t size) {
+					for(int32_t i=0; i<size; ++i)
+						checksum += data[i];
+					received += size;
+				};
+				stream->onEnd = [&]() { ended = true; };
+				stream->onReset = [&]() { reset = true; };
+			});
+	
+	serialization::Writer meta;
+	meta << (int32_t)1234;
+	uint32_t stream = client.Open("upload", &meta.GetBuffer());
+	
+	const int64_t totalSize = 16*1024*1024;
+	std::vector<uint8_t> block(100*1000);
+	uint64_t expectedChecksum = 0;
+	for(size_t i=0; i<block.size(); ++i)
+		block[i] = i*7;
+	int64_t sent = 0;
+	while(sent < totalSize) {
+		int64_t offset = sent % block.size();
+		int64_t size = std::min<int64_t>(block.size()-offset, totalSize-sent);
+		int64_t accepted = client.Write(stream, block.data()+offset, size);
+		for(int64_t i=0; i<accepted; ++i)
+			expectedChecksum += block[offset+i];
+		sent += accepted;
+		uint64_t inFlight = 0;
+		for(auto& frame : toServer)
+			inFlight += frame.Size();
+		maxInFlight = std::max(maxInFlight, inFlight);
+		Deliver(client, server);
+	}
+	client.End(stream);
+	Deliver(client, server);
+	
+	Check(1, metadata == 1234 && ended && reset == false);
+	Check(2, received == (uint64_t)totalSize && checksum == expectedChecksum);
+	Check(3, maxInFlight <= rpc::StreamManager::INITIAL_WINDOW + 1024);
+	
+	// Sender ignores credits after receiver stops returning them.
+	bool cancelled = false;
+	rpc::StreamManager::RegisterHandler("manual",
+			[&](rpc::IncomingStream* stream, serialization::Reader& reader) {
+				stream->manualCredit = true;
+			});
+	stream = client.Open("manual");
+	client.SetCallbacks(stream, NULL, [&]() { cancelled = true; });
+	int64_t accepted = client.Write(stream, block.data(), block.size());
+	accepted += client.Write(stream, block.data(), block.size());
+	accepted += client.Write(stream, block.data(), block.size());
+	Deliver(client, server);
+	bool limited = accepted == rpc::StreamManager::INITIAL_WINDOW
+		&& client.GetCredits(stream) == 0 && cancelled == false;
+	// DATA frame written past the window, bypassing Write.
+	serialization::Writer violation;
+	violation << (rpc::FunctionBase::STREAM_FLAG
+			| rpc::StreamManager::DATA) << stream;
+	violation.GetBuffer().Write(block.data(), 1000);
+	toServer.emplace_back(std::move(violation.GetBuffer()));
+	Deliver(client, server);
+	Check(4, limited && cancelled
+			&& client.Write(stream, block.data(), 10) == -1);
+	
+	stream = client.Open("unknown");
+	Deliver(client, server);
+	Check(5, client.Write(stream, block.data(), 10) == -1);
+	
+	// Receiver cancels from inside of onChunk.
+	int chunks = 0;
+	cancelled = false;
+	rpc::StreamManager::RegisterHandler("cancelling",
+			[&](rpc::IncomingStream* stream, serialization::Reader& reader) {
+				uint32_t id = stream->id;
+				stream->onChunk = [&, id](const uint8_t* data, int32_t size) {
+					++chunks;
+					server.Cancel(id);
+				};
+			});
+	stream = client.Open("cancelling");
+	client.SetCallbacks(stream, NULL, [&]() { cancelled = true; });
+	client.Write(stream, block.data(), 10);
+	client.Write(stream, block.data(), 10);
+	Deliver(client, server);
+	Check(6, chunks == 1 && cancelled);
+	
+	// Remote side cannot grow incoming streams without limit.
+	std::vector<uint32_t> opened;
+	for(size_t i=0; i<=rpc::StreamManager::MAX_INCOMING_STREAMS; ++i)
+		opened.push_back(client.Open("manual"));
+	Deliver(client, server);
+	Check(7, client.GetCredits(opened.front()) > 0
+			&& client.GetCredits(opened.back()) == -1);
+	
+	return Finish();
+}
+
@@ -0,0 +1,58 @@
+
+#include <networking/Context.hpp>
+#include <networking/Loop.hpp>
+#include <networking/Socket.hpp>
+#include <rpc/FunctionTranslation.hpp>
+
+#include <cstring>
+#include <string_view>
+
+const char* path = "/tmp/dorpc_unix_socket_test.sock";
+const int messages = 16;
+
+int received_counter = 0;
+
+int main() {
+	networking::Loop *loop = networking::Loop::Make();
+	networking::Context* context = networking::Context::Make(loop, [=](
+				networking::Socket*socket,
+				int isClient, char* b, int c) {
+				if(isClient == 0)
+					return;
+				for(int i=0; i<messages; ++i) {
+					networking::Buffer buffer;
+					char str[1024];
+					sprintf(str, "Hello %i over unix socket", i);
+					buffer.Write(str, strlen(str)+1);
+					socket->InternalSend(buffer);
+				}
+			},
+			[=](networking::Buffer& buffer, networking::Socket* socket){
+				std::string_view v((char*)buffer.Data(), buffer.Size()-1);
+				// Function table is exchanged first and never delivered.
+				bool valid = v.starts_with("Hello ")
+						&& v.ends_with(" over unix socket")
+						&& socket->GetFunctionTranslation()
+						&& socket->GetFunctionTranslation()->IsSynchronized();
+				printf(" Received (of size %i): '%s': %s\n", buffer.Size(),
+						buffer.Data(), valid?"valid":"ERROR!!!");
+				if(valid == false)
+					exit(1);
+				received_counter++;
+				if(received_counter == messages) {
+					printf(" no errors: %i/%i ... OK\n", received_counter,
+							messages);
+					exit(0);
+				}
+			}, NULL, NULL, NULL, NULL);
+	context->EnableFunctionTranslation();
+	
+	if(context->StartListeningUnix(path) == NULL) {
+		printf(" cannot listen on %s ... FAILED\n", path);
+		return 1;
+	}
+	context->InternalConnectUnix(path);
+	loop->Run();
+	return 1;
+}
+